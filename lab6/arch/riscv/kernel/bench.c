@@ -0,0 +1,613 @@
+#include "bench.h"
+
+#include "fpu.h"
+#include "mm.h"
+#include "mmap.h"
+#include "riscv.h"
+#include "sched.h"
+#include "slub.h"
+#include "stdio.h"
+#include "string.h"
+#include "vm.h"
+#include "vmalloc.h"
+
+#define BENCH_ROUNDS 512
+#define BENCH_BATCH 64
+
+static uint64_t bench_pages[BENCH_BATCH];
+
+#define BENCH_STRING_MAX 16384
+
+static char bench_src[BENCH_STRING_MAX + 8] __attribute__((aligned(8)));
+static char bench_dst[BENCH_STRING_MAX + 8] __attribute__((aligned(8)));
+
+static void bench_report(const char *name, uint64_t cycles, uint64_t ops) {
+  printf("[bench] %s: %ld ops, %ld cycles/op\n", name, ops, cycles / ops);
+}
+
+// 依次执行 op(0) 到 op(BENCH_ROUNDS - 1)，打印 name 和每次操作的平均周期数
+static void bench_run(const char *name, void (*op)(int round)) {
+  uint64_t start = rdcycle();
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    op(r);
+  }
+  bench_report(name, rdcycle() - start, BENCH_ROUNDS);
+}
+
+void bench_buddy(void) {
+  uint64_t start, cycles;
+
+  // 单页分配后立即释放，对应缺页和页表分配的热路径
+  start = rdcycle();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    free_pages(alloc_page());
+  }
+  cycles = rdcycle() - start;
+  bench_report("buddy alloc+free 1 page", cycles, BENCH_ROUNDS);
+
+  // 连续分配一批页面后再全部释放，对应 fork 时的批量分配
+  cycles = 0;
+  for (int r = 0; r < BENCH_ROUNDS / BENCH_BATCH; r++) {
+    start = rdcycle();
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      bench_pages[i] = alloc_page();
+    }
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      free_pages(bench_pages[i]);
+    }
+    cycles += rdcycle() - start;
+  }
+  bench_report("buddy batch alloc/free 1 page", cycles, BENCH_ROUNDS);
+
+  // 不同阶数交替分配，迫使分配器拆分和合并
+  cycles = 0;
+  for (int r = 0; r < BENCH_ROUNDS / BENCH_BATCH; r++) {
+    start = rdcycle();
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      bench_pages[i] = alloc_pages(1 << (i & 3));
+    }
+    for (int i = BENCH_BATCH - 1; i >= 0; i--) {
+      free_pages(bench_pages[i]);
+    }
+    cycles += rdcycle() - start;
+  }
+  bench_report("buddy mixed order 0-3", cycles, BENCH_ROUNDS);
+
+  // 不清零的分配只包含 buddy system 本身的开销
+  start = rdcycle();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    free_pages(alloc_pages_flags(1, GFP_KERNEL));
+  }
+  cycles = rdcycle() - start;
+  bench_report("buddy alloc+free 1 page, no zeroing", cycles, BENCH_ROUNDS);
+
+  // 预清零池补满后，清零的单页分配直接从池中取
+  refill_zero_pool(ZERO_POOL_SIZE);
+  start = rdcycle();
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    bench_pages[i] = alloc_page();
+  }
+  cycles = rdcycle() - start;
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    free_pages(bench_pages[i]);
+  }
+  bench_report("zeroed page from pool", cycles, BENCH_BATCH);
+}
+
+// 逐字节实现，作为字长版本的对照
+static __noinline void *byte_memcpy(void *dst, const void *src, size_t n) {
+  char *a = dst;
+  const char *b = src;
+  while (n--) {
+    *a++ = *b++;
+  }
+  return dst;
+}
+
+static __noinline void *byte_memset(void *dst, int c, size_t n) {
+  char *a = dst;
+  while (n--) {
+    *a++ = c;
+  }
+  return dst;
+}
+
+// 每种长度测量的轮数，保证每个测试搬运的总字节数相近
+static int string_rounds(size_t size) {
+  int rounds = (64 * 1024) / size;
+  return rounds > BENCH_ROUNDS ? BENCH_ROUNDS : rounds;
+}
+
+static void bench_string_size(size_t size, int misalign) {
+  char *dst = bench_dst + misalign;
+  int rounds = string_rounds(size);
+  uint64_t start;
+
+  start = rdcycle();
+  for (int i = 0; i < rounds; i++) {
+    byte_memcpy(dst, bench_src, size);
+  }
+  uint64_t byte_copy = rdcycle() - start;
+
+  start = rdcycle();
+  for (int i = 0; i < rounds; i++) {
+    memcpy(dst, bench_src, size);
+  }
+  uint64_t word_copy = rdcycle() - start;
+
+  start = rdcycle();
+  for (int i = 0; i < rounds; i++) {
+    byte_memset(dst, i, size);
+  }
+  uint64_t byte_set = rdcycle() - start;
+
+  start = rdcycle();
+  for (int i = 0; i < rounds; i++) {
+    memset(dst, i, size);
+  }
+  uint64_t word_set = rdcycle() - start;
+
+  memcpy(dst, bench_src, size);
+  start = rdcycle();
+  for (int i = 0; i < rounds; i++) {
+    if (memcmp(dst, bench_src, size) != 0) {
+      printf("error: memcmp mismatch\n");
+      while(1);
+    }
+  }
+  uint64_t word_cmp = rdcycle() - start;
+
+  printf("[bench] %ld bytes, dst offset %d: memcpy %ld -> %ld, "
+         "memset %ld -> %ld, memcmp %ld cycles/op\n",
+         size, misalign, byte_copy / rounds, word_copy / rounds,
+         byte_set / rounds, word_set / rounds, word_cmp / rounds);
+}
+
+void bench_string(void) {
+  for (int i = 0; i < BENCH_STRING_MAX + 8; i++) {
+    bench_src[i] = i * 7 + 1;
+  }
+
+  for (size_t size = 8; size <= BENCH_STRING_MAX; size <<= 1) {
+    bench_string_size(size, 0);
+    bench_string_size(size, 3);
+  }
+}
+
+#define BENCH_TLB_PAGES 4096
+#define BENCH_TLB_PASSES 4
+
+// 以 4KB 为步长读取直接映射区，每次访问都落在不同的页面上
+static uint64_t tlb_scan(uint64_t satp) {
+  uint64_t old_satp = read_csr(satp);
+  uint64_t base = buddy_base_addr();
+  uint64_t nr = buddy_nr_pages() < BENCH_TLB_PAGES ? buddy_nr_pages()
+                                                   : BENCH_TLB_PAGES;
+  volatile uint64_t sum = 0;
+
+  write_csr(satp, satp);
+  asm volatile("sfence.vma");
+  uint64_t start = rdcycle();
+  for (int pass = 0; pass < BENCH_TLB_PASSES; pass++) {
+    for (uint64_t i = 0; i < nr; i++) {
+      sum += *(volatile uint64_t *)(base + i * PAGE_SIZE);
+    }
+  }
+  uint64_t cycles = rdcycle() - start;
+  write_csr(satp, old_satp);
+  asm volatile("sfence.vma");
+  return cycles / (nr * BENCH_TLB_PASSES);
+}
+
+void bench_paging(void) {
+  uint64_t *pgtbl[2];
+  uint64_t cycles[2], pages[2];
+
+  // 预清零池中的页面已经计入 alloced_page_num，先归还以便统计页表页面数
+  drain_zero_pool();
+  for (int i = 0; i < 2; i++) {
+    vm_superpages = i == 0;
+    uint64_t start_pages = alloced_page_num();
+    uint64_t start = rdcycle();
+    pgtbl[i] = (uint64_t *)alloc_page();
+    map_kernel_space(pgtbl[i]);
+    cycles[i] = rdcycle() - start;
+    pages[i] = alloced_page_num() - start_pages;
+  }
+  vm_superpages = 1;
+
+  for (int i = 0; i < 2; i++) {
+    uint64_t satp = ((uint64_t)pgtbl[i] >> 12) | 0x8000000000000000;
+    printf("[bench] kernel space with %s: %ld cycles to build, "
+           "%ld page-table pages, %ld cycles per page touched\n",
+           i == 0 ? "superpages" : "4KB pages", cycles[i], pages[i],
+           tlb_scan(satp));
+    free_pgtbl(pgtbl[i], 2);
+  }
+}
+
+void bench_user_pgtbl(void) {
+  // 与 fork 相同的页表操作：建立进程根页表，再映射用户程序和用户栈
+  uint64_t pa = buddy_base_addr();
+
+  drain_zero_pool();
+  for (int shared = 0; shared < 2; shared++) {
+    uint64_t start_pages = alloced_page_num();
+    uint64_t start = rdcycle();
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      if (shared) {
+        bench_pages[i] = new_user_pgtbl();
+      } else {
+        bench_pages[i] = alloc_page();
+        map_kernel_space((uint64_t *)bench_pages[i]);
+      }
+      create_mapping((uint64_t *)bench_pages[i], 0x1000000, pa, PAGE_SIZE * 2,
+                     PTE_V | PTE_R | PTE_X | PTE_U | PTE_W);
+      create_mapping((uint64_t *)bench_pages[i], 0x1002000, pa, PAGE_SIZE,
+                     PTE_V | PTE_R | PTE_W | PTE_U);
+    }
+    uint64_t cycles = rdcycle() - start;
+    uint64_t pages = alloced_page_num() - start_pages;
+
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      if (shared) {
+        free_user_pgtbl(bench_pages[i]);
+      } else {
+        free_pgtbl((uint64_t *)bench_pages[i], 2);
+      }
+    }
+    printf("[bench] user page table, %s kernel space: %ld cycles, "
+           "%ld page-table pages per process\n",
+           shared ? "shared" : "private", cycles / BENCH_BATCH,
+           pages / BENCH_BATCH);
+  }
+}
+
+#define BENCH_SLUB_LIVE 512
+#define BENCH_SLUB_OPS 16384
+
+static void *bench_objs[BENCH_SLUB_LIVE];
+
+void bench_slub(void) {
+  // 随机大小（8 到 2048 字节）的 kmalloc/kfree 交替进行，保持约一半的对象存活，
+  // 使各个 cache 的 slab 不断在 partial、full、free 之间移动
+  uint64_t seed = 1;
+  uint64_t start_pages = alloced_page_num();
+  uint64_t allocs = 0, frees = 0;
+
+  uint64_t start = rdcycle();
+  for (int i = 0; i < BENCH_SLUB_OPS; i++) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    int slot = (seed >> 33) % BENCH_SLUB_LIVE;
+    if (bench_objs[slot] == NULL) {
+      bench_objs[slot] = kmalloc(8 + (seed >> 20) % 2041);
+      allocs++;
+    } else {
+      kfree(bench_objs[slot]);
+      bench_objs[slot] = NULL;
+      frees++;
+    }
+  }
+  uint64_t cycles = rdcycle() - start;
+  uint64_t held_pages = alloced_page_num() - start_pages;
+
+  for (int i = 0; i < BENCH_SLUB_LIVE; i++) {
+    kfree(bench_objs[i]);
+    bench_objs[i] = NULL;
+  }
+  printf("[bench] kmalloc/kfree mixed sizes: %ld allocs, %ld frees, "
+         "%ld cycles/op, %ld pages held before cleanup\n",
+         allocs, frees, cycles / BENCH_SLUB_OPS, held_pages);
+  slub_report();
+}
+
+static const size_t bench_zero_sizes[] = {64, 1024, 3072};
+
+void bench_kzalloc(void) {
+  // 分配后立即释放，比较 kzalloc（清零）与 kmalloc（不清零）每次的开销
+  for (int i = 0; i < 3; i++) {
+    size_t size = bench_zero_sizes[i];
+    uint64_t cycles[2];
+    for (int zero = 0; zero < 2; zero++) {
+      uint64_t start = rdcycle();
+      for (int r = 0; r < BENCH_ROUNDS; r++) {
+        kfree(zero ? kzalloc(size) : kmalloc(size));
+      }
+      cycles[zero] = (rdcycle() - start) / BENCH_ROUNDS;
+    }
+    printf("[bench] %ld-byte object: kmalloc %ld cycles, kzalloc %ld cycles\n",
+           size, cycles[0], cycles[1]);
+  }
+
+  // 一个块大小的缓冲区：专用 cache 不清零，与原来的清零分配对比
+  struct kmem_cache *blocks =
+      kmem_cache_create("bench-block-4096    ", PAGE_SIZE, PAGE_SIZE, 0, NULL);
+  uint64_t cycles[2];
+  for (int zero = 0; zero < 2; zero++) {
+    uint64_t start = rdcycle();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+      void *p = kmem_cache_alloc(blocks);
+      if (zero) {
+        memset(p, 0, PAGE_SIZE);
+      }
+      kmem_cache_free(p);
+    }
+    cycles[zero] = (rdcycle() - start) / BENCH_ROUNDS;
+  }
+  kmem_cache_destroy(blocks);
+  printf("[bench] 4096-byte block: cache alloc %ld cycles, alloc + zero %ld "
+         "cycles\n",
+         cycles[0], cycles[1]);
+}
+
+#define BENCH_SWITCHES 256
+#define BENCH_SWITCH_PAGES 32
+
+void bench_asid(void) {
+  // 在两个进程页表之间来回切换，每次切换后访问内核直接映射区中的若干页面。
+  // 旧的做法相当于每次切换都清空 TLB；现在内核映射是全局的，不同进程使用不同的 ASID
+  uint64_t pgtbl[2] = {new_user_pgtbl(), new_user_pgtbl()};
+  uint64_t old_satp = read_csr(satp);
+  uint64_t base = buddy_base_addr();
+  volatile uint64_t sum = 0;
+
+  for (int flush = 1; flush >= 0; flush--) {
+    uint64_t start = rdcycle();
+    for (int i = 0; i < BENCH_SWITCHES; i++) {
+      write_csr(satp, MAKE_SATP(pgtbl[i & 1], asid_bits ? (i & 1) + 1 : 0));
+      if (flush || asid_bits == 0) {
+        local_flush_tlb_all();
+      }
+      for (int j = 0; j < BENCH_SWITCH_PAGES; j++) {
+        sum += *(volatile uint64_t *)(base + j * PAGE_SIZE);
+      }
+    }
+    uint64_t cycles = rdcycle() - start;
+    printf("[bench] address space switch, %s: %ld cycles/switch\n",
+           flush ? "full tlb flush" : "asid + global kernel",
+           cycles / BENCH_SWITCHES);
+  }
+
+  write_csr(satp, old_satp);
+  local_flush_tlb_all();
+  free_user_pgtbl(pgtbl[0]);
+  free_user_pgtbl(pgtbl[1]);
+}
+
+#define BENCH_VMAS 256
+
+// 原来的查找方式：顺序遍历 VMA 链表
+static struct vm_area_struct *linear_find_vma(struct mm_struct *mm,
+                                              uint64_t addr) {
+  struct vm_area_struct *vma;
+  list_for_each_entry(vma, &mm->vm->vm_list, vm_list) {
+    if (addr >= vma->vm_start && addr < vma->vm_end) {
+      return vma;
+    }
+  }
+  return NULL;
+}
+
+void bench_vma(void) {
+  // 间隔一个页面建立 BENCH_VMAS 个 VMA，使它们不会被合并
+  struct mm_struct mm;
+  mm_init(&mm);
+  for (int i = 0; i < BENCH_VMAS; i++) {
+    do_mmap(&mm, (uint64_t)i * 2 * PAGE_SIZE, PAGE_SIZE, PTE_V | PTE_R | PTE_U);
+  }
+
+  for (int tree = 0; tree < 2; tree++) {
+    uint64_t found = 0;
+    uint64_t start = rdcycle();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+      // 步长与 VMA 数量互素，每次查找不同的 VMA，避免一直命中 mmap_cache
+      uint64_t addr = (uint64_t)(r * 97 % BENCH_VMAS) * 2 * PAGE_SIZE;
+      found += (tree ? find_vma(&mm, addr) : linear_find_vma(&mm, addr)) != NULL;
+    }
+    uint64_t cycles = rdcycle() - start;
+    printf("[bench] find_vma among %d vmas, %s: %ld cycles/op (%ld found)\n",
+           BENCH_VMAS, tree ? "avl tree" : "linear list", cycles / BENCH_ROUNDS,
+           found);
+  }
+  exit_mmap(&mm, 0);
+
+  // 首尾相接、权限相同的 VMA 会被合并为一个
+  for (int i = 0; i < BENCH_VMAS; i++) {
+    do_mmap(&mm, (uint64_t)i * PAGE_SIZE, PAGE_SIZE, PTE_V | PTE_R | PTE_U);
+  }
+  printf("[bench] %d adjacent mmaps -> %d vma\n", BENCH_VMAS, mm.map_count);
+  exit_mmap(&mm, 0);
+  kfree(mm.vm);
+}
+
+#define BENCH_LARGE_PAGES 5
+
+static void *bench_bufs[BENCH_BATCH];
+
+void bench_vmalloc(void) {
+  // 一批 5 页的大缓冲区：按 2 的幂分配、按页数精确分配、vmalloc 逐页拼接，
+  // 比较占用的物理页面数和每次分配 + 释放的开销
+  const char *names[] = {"alloc_pages", "alloc_pages_exact", "vmalloc"};
+  for (int kind = 0; kind < 3; kind++) {
+    uint64_t cycles = 0;
+    int held = 0;
+    for (int r = 0; r < BENCH_ROUNDS / BENCH_BATCH; r++) {
+      int before = alloced_page_num();
+      uint64_t start = rdcycle();
+      for (int i = 0; i < BENCH_BATCH; i++) {
+        if (kind == 0) {
+          bench_bufs[i] = (void *)alloc_pages_flags(BENCH_LARGE_PAGES, GFP_KERNEL);
+        } else if (kind == 1) {
+          bench_bufs[i] =
+              (void *)alloc_pages_exact(BENCH_LARGE_PAGES, GFP_KERNEL);
+        } else {
+          bench_bufs[i] = vmalloc(BENCH_LARGE_PAGES * PAGE_SIZE);
+        }
+      }
+      held = alloced_page_num() - before;
+      for (int i = 0; i < BENCH_BATCH; i++) {
+        if (kind == 0) {
+          free_pages((uint64_t)bench_bufs[i]);
+        } else if (kind == 1) {
+          free_pages_exact((uint64_t)bench_bufs[i], BENCH_LARGE_PAGES);
+        } else {
+          vfree(bench_bufs[i]);
+        }
+      }
+      cycles += rdcycle() - start;
+    }
+    printf("[bench] %s %d x %d pages: %d pages held, %ld cycles/op\n",
+           names[kind], BENCH_BATCH, BENCH_LARGE_PAGES, held,
+           cycles / BENCH_ROUNDS);
+  }
+}
+
+void bench_shrink(void) {
+  // 各个 cache 中留下一批空 slab，再模拟内存不足时的回收
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    bench_bufs[i] = kmalloc(PAGE_SIZE / 2);
+  }
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    kfree(bench_bufs[i]);
+  }
+  int before = alloced_page_num();
+  uint64_t start = rdcycle();
+  unsigned long freed = shrink_caches(~0UL);
+  uint64_t cycles = rdcycle() - start;
+  printf("[bench] shrink_caches: %ld pages reclaimed (%d -> %d held), %ld "
+         "cycles\n",
+         freed, before, alloced_page_num(), cycles);
+}
+
+// 原来的选择方式：扫描整个进程表，取优先级最高、counter 最小的进程
+static struct task_struct *linear_pick(struct task_struct **table) {
+  struct task_struct *next = NULL;
+  for (int i = BENCH_BATCH - 1; i >= 0; i--) {
+    struct task_struct *p = table[i];
+    if (p == NULL || p->counter <= 0) {
+      continue;
+    }
+    if (next == NULL || p->priority < next->priority ||
+        (p->priority == next->priority && p->counter < next->counter)) {
+      next = p;
+    }
+  }
+  return next;
+}
+
+void bench_runqueue(void) {
+  // 进程表中有 n 个可运行的进程，比较扫描进程表与运行队列选择下一个进程的开销
+  static struct task_struct *table[BENCH_BATCH];
+  const int counts[] = {2, BENCH_BATCH};
+  for (int k = 0; k < 2; k++) {
+    int n = counts[k];
+    for (int i = 0; i < n; i++) {
+      table[i] = kzalloc(sizeof(struct task_struct));
+      table[i]->counter = 1;
+      table[i]->priority = DEFAULT_PRIO - (i & 1);
+      enqueue_task(table[i]);
+    }
+
+    volatile struct task_struct *sink;
+    uint64_t start = rdcycle();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+      sink = linear_pick(table);
+    }
+    uint64_t linear = (rdcycle() - start) / BENCH_ROUNDS;
+
+    // 选出的进程移到队尾，相当于 schedule 中的轮转
+    start = rdcycle();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+      struct task_struct *p = pick_next_task(NULL);
+      dequeue_task(p);
+      enqueue_task(p);
+      sink = p;
+    }
+    uint64_t queued = (rdcycle() - start) / BENCH_ROUNDS;
+    (void)sink;
+
+    printf("[bench] pick next of %d tasks: table scan %ld cycles, runqueue "
+           "%ld cycles\n",
+           n, linear, queued);
+    for (int i = 0; i < n; i++) {
+      dequeue_task(table[i]);
+      kfree(table[i]);
+      table[i] = NULL;
+    }
+  }
+}
+
+static struct task_struct *pid_table[BENCH_BATCH];
+static struct task_struct *pid_extra;
+static volatile struct task_struct *pid_sink;
+
+static void pid_alloc_free(int round) {
+  free_pid(alloc_pid(pid_extra));
+}
+
+static void pid_lookup(int round) {
+  pid_sink = find_task_by_pid(pid_table[round % BENCH_BATCH]->pid);
+}
+
+// 原来的查找方式：扫描整个进程表
+static void pid_scan(int round) {
+  long pid = pid_table[round % BENCH_BATCH]->pid;
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    if (pid_table[i]->pid == pid) {
+      pid_sink = pid_table[i];
+      break;
+    }
+  }
+}
+
+void bench_pid(void) {
+  // 先登记一批进程，再测量 pid 的分配+释放，以及按 pid 查找与顺序扫描进程表的对比。
+  // 这里分配过的 pid 会让之后 fork 出的进程的 pid 从更大的数开始
+  spin_lock(&tasklist_lock);
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    pid_table[i] = kzalloc(sizeof(struct task_struct));
+    alloc_pid(pid_table[i]);
+  }
+  pid_extra = kzalloc(sizeof(struct task_struct));
+
+  bench_run("pid alloc+free", pid_alloc_free);
+  bench_run("find task by pid, pid table", pid_lookup);
+  bench_run("find task by pid, table scan", pid_scan);
+
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    free_pid(pid_table[i]->pid);
+    kfree(pid_table[i]);
+  }
+  kfree(pid_extra);
+  spin_unlock(&tasklist_lock);
+}
+
+static struct fp_state bench_fp;
+
+static void fp_save_restore(int round) {
+  __fp_save(&bench_fp);
+  __fp_restore(&bench_fp);
+}
+
+void bench_fpu(void) {
+  // 每次切换都保存和恢复浮点状态时的开销，按需切换时不使用浮点的进程完全省去它
+  set_csr(sstatus, SSTATUS_FS_CLEAN);
+  bench_run("fp save+restore", fp_save_restore);
+  clear_csr(sstatus, SSTATUS_FS);
+}
+
+void run_benchmarks(void) {
+  bench_buddy();
+  bench_string();
+  bench_paging();
+  bench_user_pgtbl();
+  bench_vma();
+  bench_asid();
+  bench_slub();
+  bench_kzalloc();
+  bench_vmalloc();
+  bench_shrink();
+  bench_runqueue();
+  bench_pid();
+  bench_fpu();
+}
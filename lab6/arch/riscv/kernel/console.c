@@ -0,0 +1,47 @@
+#include "console.h"
+
+#include "riscv.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "stdio.h"
+#include "timer.h"
+#include "wait.h"
+
+// 保护等待队列和 poll_timer 的状态，读取 UART 也在锁内进行
+static spinlock_t console_lock = SPINLOCK_INIT;
+static struct wait_queue_head console_wait = {
+    .head = {&console_wait.head, &console_wait.head}};
+
+// 挂在第一个等待者所在的 hart 上，到期时在该 hart 的时钟中断中运行
+static struct timer_list poll_timer;
+static bool poll_armed;
+
+static void console_poll(struct timer_list *timer) {
+  spin_lock(&console_lock);
+  // 有输入时唤醒所有等待者，它们重新读取，没读到的再次睡眠并重新设置定时器
+  if (ReadReg(LSR) & LSR_RX_READY) {
+    poll_armed = 0;
+    wake_up(&console_wait);
+  } else {
+    timer->expires += tick_cycles;
+    add_timer(timer);
+  }
+  spin_unlock(&console_lock);
+}
+
+int console_getchar(void) {
+  int ch;
+
+  spin_lock(&console_lock);
+  while ((ch = getchar()) < 0) {
+    if (!poll_armed) {
+      poll_armed = 1;
+      poll_timer.expires = rdtime() + tick_cycles;
+      poll_timer.function = console_poll;
+      add_timer(&poll_timer);
+    }
+    sleep_on(&console_wait, &console_lock);
+  }
+  spin_unlock(&console_lock);
+  return ch;
+}
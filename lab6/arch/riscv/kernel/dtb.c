@@ -0,0 +1,154 @@
+#include "dtb.h"
+
+#include "smp.h"
+#include "string.h"
+
+// 该文件中的函数在打开 MMU 之前运行，只能使用 PC 相对寻址，
+// 因此不使用 switch（跳转表中是链接时的虚拟地址）和 printf
+
+struct boot_info boot_info;
+
+struct fdt_header {
+  uint32_t magic;
+  uint32_t totalsize;
+  uint32_t off_dt_struct;
+  uint32_t off_dt_strings;
+  uint32_t off_mem_rsvmap;
+  uint32_t version;
+  uint32_t last_comp_version;
+  uint32_t boot_cpuid_phys;
+  uint32_t size_dt_strings;
+  uint32_t size_dt_struct;
+};
+
+static uint32_t fdt32(const void *p) {
+  const uint8_t *b = p;
+  return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+         ((uint32_t)b[2] << 8) | (uint32_t)b[3];
+}
+
+// 读取由 cells 个 32 位单元组成的数
+static uint64_t fdt_cells(const void *p, uint32_t cells) {
+  uint64_t val = 0;
+  for (uint32_t i = 0; i < cells; i++) {
+    val = (val << 32) | fdt32((const uint8_t *)p + i * 4);
+  }
+  return val;
+}
+
+// 节点名形如 "memory@80000000"，只比较 @ 之前的部分
+static bool node_is(const char *name, const char *prefix) {
+  size_t n = strlen(prefix);
+  return memcmp(name, prefix, n) == 0 && (name[n] == '\0' || name[n] == '@');
+}
+
+#define FDT_ALIGN(x) (((x) + 3) & ~3UL)
+
+// 在 bootargs 中查找 key=十进制数，找不到时返回 0
+static uint64_t bootarg_value(const char *args, uint32_t len, const char *key) {
+  size_t n = strlen(key);
+  for (uint32_t i = 0; i + n <= len; i++) {
+    if ((i == 0 || args[i - 1] == ' ') && memcmp(args + i, key, n) == 0) {
+      uint64_t val = 0;
+      for (i += n; i < len && args[i] >= '0' && args[i] <= '9'; i++) {
+        val = val * 10 + (args[i] - '0');
+      }
+      return val;
+    }
+  }
+  return 0;
+}
+
+void parse_dtb(uint64_t dtb_addr) {
+  boot_info.dtb_addr = dtb_addr;
+  boot_info.mem_base = PHYS_MEM_BASE;
+  boot_info.mem_size = DEFAULT_MEMORY_SIZE;
+  boot_info.timebase_freq = DEFAULT_TIMEBASE_FREQ;
+  boot_info.tick_hz = CONFIG_TICK_HZ;
+  boot_info.nr_cpus = 1;
+
+  const struct fdt_header *header = (const struct fdt_header *)dtb_addr;
+  if (dtb_addr == 0 || fdt32(&header->magic) != FDT_MAGIC) {
+    boot_info.dtb_addr = 0;
+    return;
+  }
+
+  const uint8_t *p = (const uint8_t *)dtb_addr + fdt32(&header->off_dt_struct);
+  const char *strings =
+      (const char *)dtb_addr + fdt32(&header->off_dt_strings);
+
+  // 根节点的 #address-cells/#size-cells 决定其子节点 reg 属性的格式
+  uint32_t address_cells = 2, size_cells = 1;
+  int depth = 0;
+  bool in_memory = 0, in_cpus = 0, in_chosen = 0;
+  // 仍在 /cpus 节点之内，其中的 cpu@N 子节点各对应一个 hart
+  bool under_cpus = 0;
+  uint64_t nr_cpus = 0;
+
+  while (1) {
+    uint32_t token = fdt32(p);
+    p += 4;
+    if (token == FDT_BEGIN_NODE) {
+      const char *name = (const char *)p;
+      depth++;
+      in_memory = depth == 2 && node_is(name, "memory");
+      in_cpus = depth == 2 && node_is(name, "cpus");
+      in_chosen = depth == 2 && node_is(name, "chosen");
+      if (in_cpus) {
+        under_cpus = 1;
+      } else if (under_cpus && depth == 3 && node_is(name, "cpu")) {
+        nr_cpus++;
+      }
+      p += FDT_ALIGN(strlen(name) + 1);
+    } else if (token == FDT_END_NODE) {
+      depth--;
+      if (depth < 2) {
+        under_cpus = 0;
+      }
+      // 属性总在子节点之前，离开子节点后不会再遇到父节点的属性
+      in_memory = in_cpus = in_chosen = 0;
+    } else if (token == FDT_PROP) {
+      uint32_t len = fdt32(p);
+      const char *name = strings + fdt32(p + 4);
+      const uint8_t *value = p + 8;
+      p += 8 + FDT_ALIGN(len);
+
+      if (depth == 1 && strcmp(name, "#address-cells") == 0) {
+        address_cells = fdt32(value);
+      } else if (depth == 1 && strcmp(name, "#size-cells") == 0) {
+        size_cells = fdt32(value);
+      } else if (in_memory && strcmp(name, "reg") == 0 &&
+                 len >= (address_cells + size_cells) * 4) {
+        // 只使用第一个内存区间，内核就位于其中
+        uint64_t base = fdt_cells(value, address_cells);
+        uint64_t size = fdt_cells(value + address_cells * 4, size_cells);
+        if (base <= PHYS_MEM_BASE && base + size > PHYS_MEM_BASE) {
+          boot_info.mem_base = PHYS_MEM_BASE;
+          boot_info.mem_size = base + size - PHYS_MEM_BASE;
+        }
+      } else if (in_cpus && strcmp(name, "timebase-frequency") == 0 &&
+                 len >= 4) {
+        boot_info.timebase_freq = fdt_cells(value, len >= 8 ? 2 : 1);
+      } else if (in_chosen && strcmp(name, "bootargs") == 0) {
+        uint64_t hz = bootarg_value((const char *)value, len, "tick_hz=");
+        if (hz != 0) {
+          boot_info.tick_hz = hz;
+        }
+      }
+    } else if (token == FDT_NOP) {
+      continue;
+    } else {
+      break;
+    }
+  }
+
+  if (boot_info.tick_hz > boot_info.timebase_freq) {
+    boot_info.tick_hz = boot_info.timebase_freq;
+  }
+  if (nr_cpus > 0) {
+    boot_info.nr_cpus = nr_cpus < NR_CPUS ? nr_cpus : NR_CPUS;
+  }
+  if (boot_info.mem_size > MAX_MEMORY_SIZE) {
+    boot_info.mem_size = MAX_MEMORY_SIZE;
+  }
+}
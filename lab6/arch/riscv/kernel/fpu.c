@@ -0,0 +1,64 @@
+#include "fpu.h"
+
+#include "riscv.h"
+#include "smp.h"
+#include "string.h"
+#include "task_manager.h"
+
+// 本 hart 的浮点寄存器中是哪个进程的状态。进程迁移到其他 hart 后可能在那里
+// 修改了浮点状态，因此只有它的 fp_cpu 也指向本 hart 时寄存器中的内容才有效
+static struct task_struct *fp_owner[NR_CPUS];
+
+static inline unsigned long fs_state(void) {
+  return read_csr(sstatus) & SSTATUS_FS;
+}
+
+static inline void set_fs(unsigned long fs) {
+  clear_csr(sstatus, SSTATUS_FS);
+  set_csr(sstatus, fs);
+}
+
+void fp_switch(struct task_struct *prev, struct task_struct *next) {
+  int cpu = smp_processor_id();
+
+  // 只有打开过 FS 的进程才可能是 Dirty，保存之后寄存器仍然有效
+  if (fs_state() == SSTATUS_FS_DIRTY) {
+    __fp_save(&prev->fp);
+  }
+  if (fp_owner[cpu] == next && next->fp_cpu == cpu) {
+    set_fs(SSTATUS_FS_CLEAN);
+  } else {
+    set_fs(SSTATUS_FS_OFF);
+  }
+}
+
+bool fp_trap(void) {
+  if (fs_state() != SSTATUS_FS_OFF) {
+    return 0;
+  }
+
+  int cpu = smp_processor_id();
+  struct task_struct *p = current;
+  // 恢复之前先打开 FS，否则 fld 本身也会产生异常
+  set_fs(SSTATUS_FS_CLEAN);
+  if (fp_owner[cpu] != p || p->fp_cpu != cpu) {
+    __fp_restore(&p->fp);
+    fp_owner[cpu] = p;
+    p->fp_cpu = cpu;
+    set_fs(SSTATUS_FS_CLEAN);
+  }
+  return 1;
+}
+
+void fp_flush(void) {
+  if (fs_state() == SSTATUS_FS_DIRTY) {
+    __fp_save(&current->fp);
+    set_fs(SSTATUS_FS_CLEAN);
+  }
+}
+
+void fp_reset(void) {
+  memset(&current->fp, 0, sizeof(current->fp));
+  current->fp_cpu = -1;
+  set_fs(SSTATUS_FS_OFF);
+}
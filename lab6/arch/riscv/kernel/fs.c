@@ -12,6 +12,9 @@
 
 struct sfs_fs sfs;
 bool fs_initialized = 0;
+spinlock_t sfs_lock = SPINLOCK_INIT;
+// 块缓存的数据缓冲区恰好一个块大小，使用专用的 cache 而不是每次向 buddy system 申请页面
+static struct kmem_cache *sfs_block_cache;
 
 void disk_op(int blockno, uint8_t *data, bool write) {
     struct buf b = {.disk = 0, .blockno = blockno, .data = (uint8_t *)PHYSICAL_ADDR(data)};
@@ -35,7 +38,7 @@ struct sfs_memory_block* sfs_get_block(uint32_t blockno) {
 
     // 创建新缓存块
     mb = (struct sfs_memory_block*)kmalloc(sizeof(struct sfs_memory_block));
-    mb->block.block = (char*)kmalloc(BLOCK_SIZE);
+    mb->block.block = (char*)kmem_cache_alloc(sfs_block_cache);
     disk_read(blockno, (uint8_t*)mb->block.block);
     
     mb->blockno = blockno;
@@ -77,7 +80,7 @@ void sfs_sync() {
         }
         if (mb->reclaim_count == 0) {
             list_del(&mb->inode_link);
-            kfree(mb->block.block);
+            kmem_cache_free(mb->block.block);
             kfree(mb);
         }
     }
@@ -260,8 +263,12 @@ int sfs_get_dir_entries(uint32_t dir_ino, char* files[]) {
         struct sfs_memory_block *data_mb = sfs_get_block(dir->direct[i]);
         struct sfs_entry *entries = (struct sfs_entry*)data_mb->block.block;
         for (int j = 0; j < SFS_NENTRY; j++) {
-            if (entries[j].ino) {
-                strcpy(files[count++], entries[j].filename);
+            if (entries[j].ino &&
+                copy_to_user(files[count++], entries[j].filename,
+                             strlen(entries[j].filename) + 1) != 0) {
+                sfs_put_block(data_mb);
+                sfs_put_block(mb);
+                return -1;
             }
         }
         sfs_put_block(data_mb);
@@ -272,15 +279,44 @@ int sfs_get_dir_entries(uint32_t dir_ino, char* files[]) {
 }
 
 
+// 内存不足时释放没有被引用的干净缓存块，从最早加入的一端开始。
+// 数据缓冲区回到 sfs_block_cache，空出的 slab 由随后调用的 slub shrinker 归还。
+// 分配内存的可能正是持有 sfs_lock 的文件系统自己，拿不到锁时跳过
+static unsigned long sfs_shrink(unsigned long nr_to_scan) {
+    struct list_head *pos, *prev;
+    unsigned long freed = 0;
+
+    if (!spin_trylock(&sfs_lock)) return 0;
+
+    for (pos = sfs.inode_list.prev; pos != &sfs.inode_list && freed < nr_to_scan;
+         pos = prev) {
+        prev = pos->prev;
+        struct sfs_memory_block *mb = list_entry(pos, struct sfs_memory_block, inode_link);
+        if (mb->reclaim_count == 0 && !mb->dirty) {
+            list_del(&mb->inode_link);
+            kmem_cache_free(mb->block.block);
+            kfree(mb);
+            freed++;
+        }
+    }
+    spin_unlock(&sfs_lock);
+    return freed;
+}
+
+static struct shrinker sfs_shrinker = {.name = "sfs-block", .scan = sfs_shrink};
+
 int sfs_init() {
     if (fs_initialized) return 0;
+    sfs_block_cache = kmem_cache_create("sfs-block-4096      ", BLOCK_SIZE,
+                                        BLOCK_SIZE, 0, NULL);
     disk_read(0, (uint8_t*)&sfs.super);
     sfs.freemap = (struct bitmap*)kmalloc(sizeof(struct bitmap));
     sfs.freemap->size = sfs.super.blocks;
-    sfs.freemap->map = (uint8_t*)kmalloc(BLOCK_SIZE);
+    sfs.freemap->map = (uint8_t*)kmem_cache_alloc(sfs_block_cache);
     disk_read(2, sfs.freemap->map);
     sfs.super_dirty = 0;
     INIT_LIST_HEAD(&sfs.inode_list);
+    register_shrinker(&sfs_shrinker);
     fs_initialized = 1;
     return 0;
 }
@@ -301,7 +337,7 @@ int sfs_open(const char* path, uint32_t flags) {
     if (*p == '\0') {
         for (int i = 0; i < 16; i++) {
             if (!current->fs.fds[i]) {
-                struct file *f = (struct file*)kmalloc(sizeof(struct file));
+                struct file *f = (struct file*)kzalloc(sizeof(struct file));
                 f->inode = inode_cur;
                 f->flags = flags;
                 f->off = 0;
@@ -372,7 +408,7 @@ int sfs_open(const char* path, uint32_t flags) {
     // 分配文件描述符
     for (int i = 0; i < 16; i++) {
         if (!current->fs.fds[i]) {
-            struct file *f = (struct file*)kmalloc(sizeof(struct file));
+            struct file *f = (struct file*)kzalloc(sizeof(struct file));
             f->inode = inode_cur;
             f->flags = flags;
             f->off = 0;
@@ -420,8 +456,9 @@ int sfs_read(int fd, char* buf, uint32_t len) {
         uint32_t to_read = min(len - read_bytes, BLOCK_SIZE - offset);
         
         struct sfs_memory_block *mb = sfs_get_block(f->inode->direct[blk_idx]);
-        memcpy(buf + read_bytes, mb->block.block + offset, to_read);
+        int err = copy_to_user(buf + read_bytes, mb->block.block + offset, to_read);
         sfs_put_block(mb);
+        if (err) return -1;
         
         read_bytes += to_read;
     }
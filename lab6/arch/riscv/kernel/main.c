@@ -3,17 +3,38 @@
 #include "sched.h"
 #include "mm.h"
 #include "virtio.h"
+#include "bench.h"
+#include "dtb.h"
+#include "vm.h"
+#include "mmap.h"
+#include "smp.h"
+#include "timer.h"
 
 int start_kernel() {
   puts("ZJU OSLAB 7 学号3230104546 姓名周俊康\n");
   
+  printf("[mm] memory [%lx, %lx), %ld pages managed by buddy system\n",
+         boot_info.mem_base, boot_info.mem_base + boot_info.mem_size,
+         buddy_nr_pages());
   slub_init();
+  mmap_init();
+  asid_init();
+  printf("[mm] %ld-bit ASID\n", asid_bits);
+  sched_init();
+#ifdef CONFIG_BENCH
+  run_benchmarks();
+#endif
   task_init();
   plic_init();
   virtio_disk_init();
 
-  // 设置第一次时钟中断
-  asm volatile("ecall");
+  // 设置第一次时钟中断，只有一个进程时不需要 tick
+  timer_init();
+  printf("[timer] %ld Hz tick, timebase %ld Hz\n", tick_hz,
+         boot_info.timebase_freq);
+
+  // 其他 hart 从这里开始调度 fork 出的进程
+  smp_boot_secondaries();
   
   call_first_process();
   dead_loop();
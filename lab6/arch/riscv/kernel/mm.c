@@ -1,44 +1,57 @@
 #include "mm.h"
 
 #include "vm.h"
+#include "dtb.h"
+#include "spinlock.h"
 #include "stdio.h"
 
-#define set_split(x) ((unsigned int)(x) | 0x80000000)
-#define set_unsplit(x) ((unsigned int)(x) & 0x7fffffff)
-#define get_size(x) set_unsplit(x)
-#define check_split(x) ((unsigned int)(x) & 0x80000000)
+#define BUDDY_FREE 0x80
+#define pfn_to_addr(pfn) (buddy_system.base_addr + ((uint64_t)(pfn)) * PAGE_SIZE)
+#define addr_to_pfn(pa) (((uint64_t)(pa) - buddy_system.base_addr) / PAGE_SIZE)
 
-uint64_t get_index(uint64_t va) {
-  uint64_t offset = (va - buddy_system.base_addr) / PAGE_SIZE;
-  int block_size = 1;
-  while(offset % block_size == 0) {
-    block_size <<= 1;
-  }
-  block_size = block_size >> 1;
-  return ((MEMORY_SIZE / PAGE_SIZE) / block_size) + (offset / block_size);
-}
+static buddy buddy_system;
+static uint64_t nr_free_pages;
+
+// 保护空闲链表、order 数组和预清零页面池。清零页面和调用 shrinker 时不持有
+static spinlock_t buddy_lock = SPINLOCK_INIT;
+
+static uint64_t zero_pool[ZERO_POOL_SIZE];
+static int zero_pool_count;
+
+// 已注册的 shrinker，只在打开 MMU 之后访问
+static LIST_HEAD(shrinker_list);
 
-uint64_t get_addr(int index) {
-  int level = 0, index_copy = index;
-  while(index_copy > 1) {
-    index_copy >>= 1;
-    level++;
+static void __free_pages(uint64_t pa);
+static void __drain_zero_pool();
+
+// 返回满足 2^order >= num 的最小阶数
+static unsigned int get_order(unsigned int num) {
+  unsigned int order = 0;
+  while ((1U << order) < num) {
+    order++;
   }
+  return order;
+}
 
-  int block_size = MEMORY_SIZE >> level;
-  int offset = (index - (1 << level)) * block_size;
-  return buddy_system.base_addr + offset;
+static void add_free_block(uint64_t pfn, unsigned int order) {
+  buddy_system.order[pfn] = order | BUDDY_FREE;
+  list_add(&buddy_system.link[pfn], &buddy_system.free_area[order].free_list);
+  buddy_system.free_area[order].nr_free++;
+  nr_free_pages += 1UL << order;
 }
 
-uint32_t get_block_size(int index) {
-  int level = 0, index_copy = index;
-  while(index_copy > 1) {
-    index_copy >>= 1;
-    level++;
-  }
-  return MEMORY_SIZE >> level;
+static void del_free_block(uint64_t pfn, unsigned int order) {
+  buddy_system.order[pfn] = 0;
+  list_del(&buddy_system.link[pfn]);
+  buddy_system.free_area[order].nr_free--;
+  nr_free_pages -= 1UL << order;
 }
 
+// 判断 pfn 是否为一个阶数恰好为 order 的空闲块的首页
+static bool is_free_block(uint64_t pfn, unsigned int order) {
+  return pfn + (1UL << order) <= buddy_system.nr_pages &&
+         buddy_system.order[pfn] == (order | BUDDY_FREE);
+}
 
 uint64_t alloc_page() {
   return alloc_pages(1);
@@ -46,147 +59,294 @@ uint64_t alloc_page() {
 
 int alloced_page_num() {
   // 返回已经分配的物理页面的数量
-  // 在buddy system中，我们不再使用该函数
-  return -1;
+  return buddy_system.nr_pages - nr_free_pages;
+}
+
+uint64_t buddy_base_addr() {
+  return buddy_system.base_addr;
+}
+
+uint64_t buddy_nr_pages() {
+  return buddy_system.nr_pages;
 }
 
 void init_buddy_system() {
-  // TODO: 初始化buddy system
-  // 1. 将buddy system的每个节点初始化为可分配的内存大小，单位为PAGE_SIZE
-  // 注意我们用buddy_system.bitmap实现一个满二叉树，其下标变化规律如下：如果当前节点的下标是 X，那么左儿子就是 `X * 2` ，右儿子就是 `X * 2 + 1` ，X 从1开始。
-  // 那么，下标为 X 的节点可分配的内存为多少呢？
-  // 2. 将buddy system的base_addr设置为&_end的物理地址
-  // 3. 将buddy system的initialized设置为true
-
-  buddy_system.bitmap[1] = MEMORY_SIZE / PAGE_SIZE;
-  for(int i = 2; i < 8192; ++i) {
-    if(buddy_system.bitmap[i] == 0) {
-      buddy_system.bitmap[i] = buddy_system.bitmap[i/2] / 2;
+  // _end 到内存末尾之间先放 link、order 两个数组，每个页面占用
+  // sizeof(struct list_head) + 1 字节，剩下按页对齐的部分全部交给 buddy system
+  for (int i = 0; i < MAX_ORDER; ++i) {
+    INIT_LIST_HEAD(&buddy_system.free_area[i].free_list);
+    buddy_system.free_area[i].nr_free = 0;
+  }
+  uint64_t start = PHYSICAL_ADDR((uint64_t)&_end);
+  uint64_t end = boot_info.mem_base + boot_info.mem_size;
+  uint64_t meta_size = sizeof(struct list_head) + sizeof(unsigned char);
+  uint64_t nr_meta = (end - start) / (PAGE_SIZE + meta_size);
+
+  buddy_system.link = (struct list_head *)start;
+  buddy_system.order =
+      (unsigned char *)(start + nr_meta * sizeof(struct list_head));
+  memset(buddy_system.order, 0, nr_meta);
+  buddy_system.base_addr =
+      (start + nr_meta * meta_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+  buddy_system.nr_pages = (end - buddy_system.base_addr) / PAGE_SIZE;
+  if (buddy_system.nr_pages > nr_meta) {
+    buddy_system.nr_pages = nr_meta;
+  }
+  nr_free_pages = 0;
+
+  // 把 [base_addr, base_addr + nr_pages * PAGE_SIZE) 切分成尽可能大的对齐块挂到空闲链表上
+
+  uint64_t pfn = 0;
+  while (pfn < buddy_system.nr_pages) {
+    unsigned int order = MAX_ORDER - 1;
+    while ((pfn & ((1UL << order) - 1)) != 0 ||
+           pfn + (1UL << order) > buddy_system.nr_pages) {
+      order--;
     }
+    add_free_block(pfn, order);
+    pfn += 1UL << order;
   }
-  buddy_system.base_addr = PHYSICAL_ADDR((uint64_t)&_end);
   buddy_system.initialized = 1;
 };
 
-uint64_t alloc_buddy(int index, unsigned int num) {
-  // TODO: 找到可分配的节点并完成分配，返回分配的物理页面的首地址（通过get_addr函数可以获取节点index的起始地址）
-  // 1. 如果当前节点的可连续分配内存大于num，则查看当前节点的左右儿子节点
-  // 提示：通过get_size函数可以获取节点index的可连续分配内存大小
-  // 2. 如果当前节点的可连续分配内存等于num，且当前节点没有被拆分，则分配当前节点
-  // 提示：通过check_split函数可以获取节点index的状态
-  // 3. 如果当前节点的可连续分配内存等于num且已经被拆分，则查看当前节点的左右儿子节点
-  // 4. 如果当前节点的可连续分配内存小于num，则分配失败返回上层节点
-  // 如果完成分配，则要递归更新节点信息，将涉及到的节点的可连续分配内存减去num，并使用set_split更新节点的状态
-  if (get_size(buddy_system.bitmap[index]) > num) {
-    uint64_t addr = alloc_buddy(index * 2, num);
-    if(addr == 0) {
-      addr = alloc_buddy(index * 2 + 1, num);
-    }
-    if (addr != 0) {
-      buddy_system.bitmap[index] = set_split(
-        get_size(buddy_system.bitmap[index*2]) > get_size(buddy_system.bitmap[index*2+1]) ? 
-        get_size(buddy_system.bitmap[index*2]) : get_size(buddy_system.bitmap[index*2+1]));
-    }
-    return addr;
-  }
-  else if (get_size(buddy_system.bitmap[index]) == num) {
-    if (!check_split(buddy_system.bitmap[index])) {
-      buddy_system.bitmap[index] = 0;
-      return get_addr(index);
-    }
-    else {
-      uint64_t addr = alloc_buddy(index * 2, num);
-      if(addr == 0) {
-        addr = alloc_buddy(index * 2 + 1, num);
-      }
-      if (addr != 0) {
-        buddy_system.bitmap[index] = buddy_system.bitmap[index]-num;
-      }
-      return addr;
+uint64_t alloc_buddy(unsigned int order) {
+  // 从 order 开始向上找到第一条非空的空闲链表，取出一个块，
+  // 再把多余的部分逐级对半拆分，放回低阶的空闲链表
+  unsigned int cur;
+  for (cur = order; cur < MAX_ORDER; ++cur) {
+    if (!list_empty(&buddy_system.free_area[cur].free_list)) {
+      break;
     }
   }
-  else {
+  if (cur == MAX_ORDER) {
     return 0;
   }
+
+  uint64_t pfn = buddy_system.free_area[cur].free_list.next - buddy_system.link;
+  del_free_block(pfn, cur);
+  while (cur > order) {
+    cur--;
+    add_free_block(pfn + (1UL << cur), cur);
+  }
+  buddy_system.order[pfn] = order;
+  return pfn_to_addr(pfn);
 }
 
-uint64_t alloc_pages(unsigned int num) {
+uint64_t alloc_pages_flags(unsigned int num, unsigned int flags) {
   // 分配num个页面，返回分配到的页面的首地址，如果没有足够的空闲页面，返回0
   if (!buddy_system.initialized) {
     init_buddy_system();
   }
 
-  uint64_t addr = 0;
+  spin_lock(&buddy_lock);
+  // 单页的清零请求优先从预清零池中取，省去热路径上的清零
+  if (num == 1 && (flags & GFP_ZERO) && zero_pool_count > 0) {
+    uint64_t addr = zero_pool[--zero_pool_count];
+    spin_unlock(&buddy_lock);
+    return addr;
+  }
 
-  // TODO:
-  // 1. 将num向上对齐到2的幂次
-  // 2. 调用alloc_buddy函数完成分配
+  unsigned int order = get_order(num);
+  uint64_t addr = alloc_buddy(order);
+  if (addr == 0 && zero_pool_count > 0) {
+    __drain_zero_pool();
+    addr = alloc_buddy(order);
+  }
+  spin_unlock(&buddy_lock);
 
-  int i = 1;
-  while (i < num) {
-    i *= 2;
+  // 回收到的页面不一定能合并出足够大的块，因此只要还有进展就继续回收
+  while (addr == 0 && shrink_caches(1UL << order) > 0) {
+    spin_lock(&buddy_lock);
+    addr = alloc_buddy(order);
+    spin_unlock(&buddy_lock);
   }
-  addr = alloc_buddy(1, i);
 
-  // set the allocated pages to 0
-  if (addr != 0) {
-    for(int i = 0; i < num * PAGE_SIZE; ++i) {
-      *(char *)(addr + i) = 0;
-    }
+  if (addr != 0 && (flags & GFP_ZERO)) {
+    memset((void *)addr, 0, num * PAGE_SIZE);
   }
 
   return addr;
 }
 
+uint64_t alloc_pages(unsigned int num) {
+  return alloc_pages_flags(num, GFP_ZERO);
+}
 
-void free_buddy(int index) {
-  // TODO: 释放节点index的页面
-  // 1. 首先判断节点index的状态，如果已经被拆分，则不能直接释放。异常状态，报错并进入死循环。
-  // 2. 如果没有被拆分，则恢复节点index的状态为初始状态
-  // 3. 如果该节点与其兄弟节点都没有被使用，则合并这两个节点，并迭代处理父节点
-  // 提示：使用check_split函数可以获取节点index的状态
-  // 提示：使用set_unsplit函数可以将节点index的状态恢复为初始状态
-  // 提示：使用get_block_size函数可以获取节点index的初始可连续分配内存大小
+uint64_t alloc_pages_exact(unsigned int num, unsigned int flags) {
+  // 先按 2 的幂分配，再把块从高到低逐级对半拆分：前半块整个在 num 页之内时保留
+  // 为一个独立的块，继续拆后半块；后半块整个多余时直接挂回空闲链表。
+  // 最终保留的是按 num 的二进制位从高到低排列的若干对齐块，多余的页面全部归还
+  uint64_t addr = alloc_pages_flags(num, flags);
+  if (addr == 0) {
+    return 0;
+  }
+  spin_lock(&buddy_lock);
+  uint64_t pfn = addr_to_pfn(addr);
+  unsigned int order = buddy_system.order[pfn];
+  while ((1UL << order) != num) {
+    order--;
+    uint64_t half = 1UL << order;
+    if (num > half) {
+      buddy_system.order[pfn] = order;
+      pfn += half;
+      num -= half;
+    } else {
+      add_free_block(pfn + half, order);
+    }
+  }
+  buddy_system.order[pfn] = order;
+  spin_unlock(&buddy_lock);
+  return addr;
+}
 
-  if (check_split(buddy_system.bitmap[index])) {
+void free_pages_exact(uint64_t pa, unsigned int num) {
+  // 与 alloc_pages_exact 的拆分方式相同，按 num 的二进制位从高到低逐块释放
+  while (num > 0) {
+    uint64_t size = 1UL << (31 - __builtin_clz(num));
+    free_pages(pa);
+    pa += size * PAGE_SIZE;
+    num -= size;
+  }
+}
+
+int refill_zero_pool(int batch) {
+  if (!buddy_system.initialized) {
+    return 0;
+  }
+  // 池满时不碰锁，空闲的 hart 反复调用也不会与正在分配的 hart 争用
+  while (batch-- > 0 && READ_ONCE(zero_pool_count) < ZERO_POOL_SIZE) {
+    spin_lock(&buddy_lock);
+    uint64_t addr = alloc_buddy(0);
+    spin_unlock(&buddy_lock);
+    if (addr == 0) {
+      break;
+    }
+    memset((void *)addr, 0, PAGE_SIZE);
+
+    spin_lock(&buddy_lock);
+    bool full = zero_pool_count == ZERO_POOL_SIZE;
+    if (full) {
+      __free_pages(addr);
+    } else {
+      zero_pool[zero_pool_count++] = addr;
+    }
+    spin_unlock(&buddy_lock);
+    if (full) {
+      break;
+    }
+  }
+  return READ_ONCE(zero_pool_count);
+}
+
+static void __drain_zero_pool() {
+  while (zero_pool_count > 0) {
+    __free_pages(zero_pool[--zero_pool_count]);
+  }
+}
+
+void drain_zero_pool() {
+  spin_lock(&buddy_lock);
+  __drain_zero_pool();
+  spin_unlock(&buddy_lock);
+}
+
+void free_pages(uint64_t pa) {
+  spin_lock(&buddy_lock);
+  __free_pages(pa);
+  spin_unlock(&buddy_lock);
+}
+
+// 调用者持有 buddy_lock
+static void __free_pages(uint64_t pa) {
+  // 块的阶数记录在首页的 order 中，伙伴块的页框号为 pfn ^ (1 << order)，
+  // 若伙伴块同阶且空闲则合并，并继续尝试与更高一阶的伙伴合并
+  uint64_t pfn = addr_to_pfn(pa);
+  if (pa < buddy_system.base_addr || pfn >= buddy_system.nr_pages ||
+      (pa & (PAGE_SIZE - 1)) || (buddy_system.order[pfn] & BUDDY_FREE)) {
     printf("error: free page failed\n");
     while(1);
     return;
   }
-  else {
-    buddy_system.bitmap[index] = get_block_size(index);
-    while (index != 1) {
-      if (buddy_system.bitmap[index] == buddy_system.bitmap[index ^ 1]) {
-        buddy_system.bitmap[index / 2] = buddy_system.bitmap[index] + buddy_system.bitmap[index ^ 1];
-        index /= 2;
-      }
-      else {
-        break;
-      }
+
+  unsigned int order = buddy_system.order[pfn];
+  buddy_system.order[pfn] = 0;
+  while (order < MAX_ORDER - 1) {
+    uint64_t buddy_pfn = pfn ^ (1UL << order);
+    if (!is_free_block(buddy_pfn, order)) {
+      break;
     }
+    del_free_block(buddy_pfn, order);
+    pfn &= ~(1UL << order);
+    order++;
   }
+  add_free_block(pfn, order);
 }
 
-void free_pages(uint64_t pa) {
-  // TODO: find the buddy system node according to pa, and free it.
-  // 注意，如果该节点的状态为已经被拆分，则应该释放其左子节点
-  // 提示：使用get_index函数可以获取pa对应的最上层节点的下标
+void register_shrinker(struct shrinker *shrinker) {
+  list_add(&shrinker->list, &shrinker_list);
+}
+
+unsigned long shrink_caches(unsigned long nr) {
+  struct shrinker *shrinker;
+  unsigned long freed = 0;
 
-  int index = get_index(pa);
-  while(check_split(buddy_system.bitmap[index])) {
-    index *= 2;
+  // 每个 shrinker 都要调用：上层缓存释放的对象只有经过下层的 shrinker 才会变成空闲页面
+  list_for_each_entry(shrinker, &shrinker_list, list) {
+    freed += shrinker->scan(nr);
   }
-  free_buddy(index);
+  return freed;
+}
 
+void split_pages(uint64_t pa, unsigned int num) {
+  // 块内除首页外的 order 本来就是 0，把首页的阶数清零后每一页都是独立的 0 阶块
+  spin_lock(&buddy_lock);
+  uint64_t pfn = addr_to_pfn(pa);
+  unsigned int order = buddy_system.order[pfn];
+  buddy_system.order[pfn] = 0;
+  for (uint64_t i = num; i < (1UL << order); i++) {
+    __free_pages(pfn_to_addr(pfn + i));
+  }
+  spin_unlock(&buddy_lock);
+}
 
-  return;
+static struct page *user_page(uint64_t pa) {
+  if (pa < buddy_system.base_addr || addr_to_pfn(pa) >= buddy_system.nr_pages) {
+    return NULL;
+  }
+  return addr_to_page(pa);
+}
 
+uint64_t alloc_user_pages(unsigned int num, unsigned int flags) {
+  uint64_t pa = alloc_pages_flags(num, flags);
+  if (pa == 0) {
+    return 0;
+  }
+  split_pages(pa, num);
+  for (unsigned int i = 0; i < num; i++) {
+    addr_to_page(pa + i * PAGE_SIZE)->refcount = 1;
+  }
+  return pa;
 }
 
-void memcpy(void * dst, void * src, size_t size) {
-  char * a = dst;
-  char * b = src;
-  while (size--) {
-    *a++ = *b++;
+// 写时复制的页面由不同 hart 上的进程共享，引用计数使用原子操作
+void get_page(uint64_t pa) {
+  struct page *page = user_page(pa);
+  if (page) {
+    atomic_fetch_add(&page->refcount, 1);
+  }
+}
+
+void put_page(uint64_t pa) {
+  struct page *page = user_page(pa);
+  if (page == NULL) {
+    return;
   }
-}
\ No newline at end of file
+  if (atomic_fetch_add(&page->refcount, -1) == 1) {
+    free_pages(pa & ~(PAGE_SIZE - 1));
+  }
+}
+
+int page_count(uint64_t pa) {
+  struct page *page = user_page(pa);
+  return page ? READ_ONCE(page->refcount) : 1;
+}
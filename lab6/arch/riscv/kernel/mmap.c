@@ -0,0 +1,508 @@
+#include "mmap.h"
+
+#include "mm.h"
+#include "slub.h"
+#include "stdio.h"
+#include "vm.h"
+#include "vmalloc.h"
+
+int fault_around_pages = FAULT_AROUND_PAGES;
+
+static struct kmem_cache *vm_area_cachep;
+
+#define PAGE_ALIGN_UP(x) (((x) + PAGE_SIZE - 1) & PAGE_MASK)
+#define BITS_PER_WORD 64
+
+// VMA 的起始地址和结束地址都按页对齐
+static uint64_t vma_nr_pages(struct vm_area_struct *vma) {
+  return (vma->vm_end - vma->vm_start) / PAGE_SIZE;
+}
+
+// vma 中第 idx 个页面的虚拟地址
+static uint64_t vma_page_addr(struct vm_area_struct *vma, uint64_t idx) {
+  return vma->vm_start + idx * PAGE_SIZE;
+}
+
+static uint64_t vma_page_index(struct vm_area_struct *vma, uint64_t addr) {
+  return ((addr & PAGE_MASK) - vma->vm_start) / PAGE_SIZE;
+}
+
+static bool page_resident(struct vm_area_struct *vma, uint64_t idx) {
+  return (vma->resident[idx / BITS_PER_WORD] >> (idx % BITS_PER_WORD)) & 1;
+}
+
+static void set_resident(struct vm_area_struct *vma, uint64_t idx) {
+  vma->resident[idx / BITS_PER_WORD] |= 1UL << (idx % BITS_PER_WORD);
+  vma->nr_resident++;
+}
+
+static void clear_resident(struct vm_area_struct *vma, uint64_t idx) {
+  vma->resident[idx / BITS_PER_WORD] &= ~(1UL << (idx % BITS_PER_WORD));
+  vma->nr_resident--;
+}
+
+static size_t resident_size(uint64_t start, uint64_t end) {
+  return ((end - start) / PAGE_SIZE + BITS_PER_WORD - 1) / BITS_PER_WORD *
+         sizeof(uint64_t);
+}
+
+// 把 src 中落在 dst 范围内的驻留位复制到 dst
+static void copy_resident(struct vm_area_struct *dst,
+                          struct vm_area_struct *src) {
+  uint64_t lo = dst->vm_start > src->vm_start ? dst->vm_start : src->vm_start;
+  uint64_t hi = dst->vm_end < src->vm_end ? dst->vm_end : src->vm_end;
+  for (uint64_t addr = lo; addr < hi && src->nr_resident > 0;
+       addr += PAGE_SIZE) {
+    if (page_resident(src, vma_page_index(src, addr))) {
+      set_resident(dst, vma_page_index(dst, addr));
+    }
+  }
+}
+
+// 把 vma 的范围改为 [start, end)，重建驻留位图，保留两个范围重叠部分的驻留位
+static int vma_adjust(struct vm_area_struct *vma, uint64_t start,
+                      uint64_t end) {
+  uint64_t *bits = kvzalloc(resident_size(start, end));
+  if (bits == NULL) {
+    printf("vma_adjust: kvzalloc failed!\n");
+    return -1;
+  }
+
+  struct vm_area_struct old = *vma;
+  vma->vm_start = start;
+  vma->vm_end = end;
+  vma->resident = bits;
+  vma->nr_resident = 0;
+  if (old.resident != NULL) {
+    copy_resident(vma, &old);
+    kvfree(old.resident);
+  }
+  return 0;
+}
+
+// vm_area_cachep 的构造函数：空闲的 VMA 对象没有驻留位图，vma_free 时恢复该状态
+static void *vma_ctor(void *object) {
+  struct vm_area_struct *vma = object;
+  vma->resident = NULL;
+  vma->nr_resident = 0;
+  return vma;
+}
+
+void mmap_init(void) {
+  vm_area_cachep = kmem_cache_create("vm_area_struct      ",
+                                     sizeof(struct vm_area_struct), 8, 0,
+                                     vma_ctor);
+}
+
+static struct vm_area_struct *vma_alloc(uint64_t start, uint64_t end,
+                                        uint64_t flags) {
+  struct vm_area_struct *vma = kmem_cache_alloc(vm_area_cachep);
+  if (vma == NULL) {
+    return NULL;
+  }
+  vma->vm_flags = flags;
+  if (vma_adjust(vma, start, end) != 0) {
+    kmem_cache_free(vma);
+    return NULL;
+  }
+  return vma;
+}
+
+static void vma_free(struct vm_area_struct *vma) {
+  kvfree(vma->resident);
+  vma_ctor(vma);
+  kmem_cache_free(vma);
+}
+
+/* AVL 树，按 vm_start 排序，VMA 之间互不重叠 */
+
+static int avl_height(struct vm_area_struct *v) {
+  return v ? v->vm_height : 0;
+}
+
+static void avl_update(struct vm_area_struct *v) {
+  int l = avl_height(v->vm_left), r = avl_height(v->vm_right);
+  v->vm_height = (l > r ? l : r) + 1;
+}
+
+static struct vm_area_struct *avl_rotate_right(struct vm_area_struct *y) {
+  struct vm_area_struct *x = y->vm_left;
+  y->vm_left = x->vm_right;
+  x->vm_right = y;
+  avl_update(y);
+  avl_update(x);
+  return x;
+}
+
+static struct vm_area_struct *avl_rotate_left(struct vm_area_struct *x) {
+  struct vm_area_struct *y = x->vm_right;
+  x->vm_right = y->vm_left;
+  y->vm_left = x;
+  avl_update(x);
+  avl_update(y);
+  return y;
+}
+
+static struct vm_area_struct *avl_balance(struct vm_area_struct *v) {
+  avl_update(v);
+  int bf = avl_height(v->vm_left) - avl_height(v->vm_right);
+  if (bf > 1) {
+    if (avl_height(v->vm_left->vm_left) < avl_height(v->vm_left->vm_right)) {
+      v->vm_left = avl_rotate_left(v->vm_left);
+    }
+    return avl_rotate_right(v);
+  }
+  if (bf < -1) {
+    if (avl_height(v->vm_right->vm_right) < avl_height(v->vm_right->vm_left)) {
+      v->vm_right = avl_rotate_right(v->vm_right);
+    }
+    return avl_rotate_left(v);
+  }
+  return v;
+}
+
+static struct vm_area_struct *avl_insert(struct vm_area_struct *root,
+                                         struct vm_area_struct *vma) {
+  if (root == NULL) {
+    vma->vm_left = vma->vm_right = NULL;
+    vma->vm_height = 1;
+    return vma;
+  }
+  if (vma->vm_start < root->vm_start) {
+    root->vm_left = avl_insert(root->vm_left, vma);
+  } else {
+    root->vm_right = avl_insert(root->vm_right, vma);
+  }
+  return avl_balance(root);
+}
+
+static struct vm_area_struct *avl_remove_min(struct vm_area_struct *root,
+                                             struct vm_area_struct **min) {
+  if (root->vm_left == NULL) {
+    *min = root;
+    return root->vm_right;
+  }
+  root->vm_left = avl_remove_min(root->vm_left, min);
+  return avl_balance(root);
+}
+
+static struct vm_area_struct *avl_erase(struct vm_area_struct *root,
+                                        struct vm_area_struct *vma) {
+  if (root == vma) {
+    struct vm_area_struct *left = root->vm_left, *right = root->vm_right, *min;
+    if (right == NULL) {
+      return left;
+    }
+    right = avl_remove_min(right, &min);
+    min->vm_left = left;
+    min->vm_right = right;
+    return avl_balance(min);
+  }
+  if (vma->vm_start < root->vm_start) {
+    root->vm_left = avl_erase(root->vm_left, vma);
+  } else {
+    root->vm_right = avl_erase(root->vm_right, vma);
+  }
+  return avl_balance(root);
+}
+
+// 返回第一个 vm_end > addr 的 VMA，不存在时返回 NULL
+static struct vm_area_struct *vma_lower_bound(struct mm_struct *mm,
+                                              uint64_t addr) {
+  struct vm_area_struct *node = mm->mmap_root, *result = NULL;
+  while (node != NULL) {
+    if (node->vm_end > addr) {
+      result = node;
+      if (node->vm_start <= addr) {
+        break;
+      }
+      node = node->vm_left;
+    } else {
+      node = node->vm_right;
+    }
+  }
+  return result;
+}
+
+static struct vm_area_struct *vma_next(struct mm_struct *mm,
+                                       struct vm_area_struct *vma) {
+  if (vma->vm_list.next == &mm->vm->vm_list) {
+    return NULL;
+  }
+  return list_entry(vma->vm_list.next, struct vm_area_struct, vm_list);
+}
+
+// 把 vma 插入树中，同时插入到链表中保持地址顺序
+static void vma_link(struct mm_struct *mm, struct vm_area_struct *vma) {
+  struct vm_area_struct *next = vma_lower_bound(mm, vma->vm_start);
+  if (next != NULL) {
+    list_add_before(&(vma->vm_list), &(next->vm_list));
+  } else {
+    list_add_tail(&(vma->vm_list), &(mm->vm->vm_list));
+  }
+  mm->mmap_root = avl_insert(mm->mmap_root, vma);
+  mm->map_count++;
+}
+
+static void vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma) {
+  mm->mmap_root = avl_erase(mm->mmap_root, vma);
+  list_del(&(vma->vm_list));
+  if (mm->mmap_cache == vma) {
+    mm->mmap_cache = NULL;
+  }
+  mm->map_count--;
+}
+
+void mm_init(struct mm_struct *mm) {
+  mm->vm = kmalloc(sizeof(struct vm_area_struct));
+  INIT_LIST_HEAD(&(mm->vm->vm_list));
+  mm->mmap_root = NULL;
+  mm->mmap_cache = NULL;
+  mm->map_count = 0;
+  // 代数 0 不会与当前代数相同，第一次切换到该进程时分配 ASID
+  mm->context_id = 0;
+}
+
+struct vm_area_struct *find_vma(struct mm_struct *mm, uint64_t addr) {
+  // 连续的缺页通常落在同一个 VMA 中，先检查上一次命中的 VMA
+  struct vm_area_struct *vma = mm->mmap_cache;
+  if (vma != NULL && addr >= vma->vm_start && addr < vma->vm_end) {
+    return vma;
+  }
+  vma = vma_lower_bound(mm, addr);
+  if (vma == NULL || vma->vm_start > addr) {
+    return NULL;
+  }
+  mm->mmap_cache = vma;
+  return vma;
+}
+
+// [start, end) 必须在用户地址范围内，并且不能覆盖程序和用户栈
+static bool user_range_ok(uint64_t start, uint64_t end) {
+  return start <= end && end <= USER_MMAP_END &&
+         (end <= USER_FIXED_START || start >= USER_FIXED_END);
+}
+
+struct vm_area_struct *do_mmap(struct mm_struct *mm, uint64_t start,
+                               uint64_t len, uint64_t flags) {
+  if ((start & ~PAGE_MASK) != 0 || len == 0 || start + len < start) {
+    return NULL;
+  }
+  uint64_t end = PAGE_ALIGN_UP(start + len);
+  if (!user_range_ok(start, end)) {
+    return NULL;
+  }
+
+  // 不允许与已有的 VMA 重叠
+  struct vm_area_struct *next = vma_lower_bound(mm, start);
+  if (next != NULL && next->vm_start < end) {
+    return NULL;
+  }
+  struct vm_area_struct *prev = NULL;
+  if (next != NULL) {
+    if (next->vm_list.prev != &mm->vm->vm_list) {
+      prev = list_entry(next->vm_list.prev, struct vm_area_struct, vm_list);
+    }
+  } else if (!list_empty(&mm->vm->vm_list)) {
+    prev = list_entry(mm->vm->vm_list.prev, struct vm_area_struct, vm_list);
+  }
+
+  // 与首尾相接且权限相同的 VMA 合并，VMA 的起始地址不变时树不需要调整
+  bool merge_prev = prev != NULL && prev->vm_end == start &&
+                    prev->vm_flags == flags;
+  bool merge_next = next != NULL && next->vm_start == end &&
+                    next->vm_flags == flags;
+  if (merge_prev && merge_next) {
+    if (vma_adjust(prev, prev->vm_start, next->vm_end) != 0) {
+      return NULL;
+    }
+    copy_resident(prev, next);
+    vma_unlink(mm, next);
+    vma_free(next);
+    return prev;
+  }
+  if (merge_prev) {
+    return vma_adjust(prev, prev->vm_start, end) == 0 ? prev : NULL;
+  }
+  if (merge_next) {
+    // next 的起始地址向前移动到 start，[start, end) 中没有其他 VMA，树中的顺序不变
+    return vma_adjust(next, start, next->vm_end) == 0 ? next : NULL;
+  }
+
+  struct vm_area_struct *vma = vma_alloc(start, end, flags);
+  if (vma == NULL) {
+    return NULL;
+  }
+  vma_link(mm, vma);
+  return vma;
+}
+
+// 解除 vma 中 [start, end) 内驻留页面的映射
+static void vma_unmap_pages(uint64_t pgtbl, struct vm_area_struct *vma,
+                            uint64_t start, uint64_t end) {
+  // 只有驻留的页面有页表项，查位图即可，不需要逐页查页表
+  for (uint64_t addr = start; addr < end && vma->nr_resident > 0;
+       addr += PAGE_SIZE) {
+    uint64_t idx = vma_page_index(vma, addr);
+    if (page_resident(vma, idx)) {
+      unmap_user_range(pgtbl, addr, addr + PAGE_SIZE);
+      clear_resident(vma, idx);
+    }
+  }
+}
+
+int do_munmap(struct mm_struct *mm, uint64_t pgtbl, uint64_t start,
+              uint64_t len) {
+  if ((start & ~PAGE_MASK) != 0 || len == 0 || start + len < start) {
+    return -1;
+  }
+  uint64_t end = PAGE_ALIGN_UP(start + len);
+
+  struct vm_area_struct *vma = vma_lower_bound(mm, start), *next;
+  for (; vma != NULL && vma->vm_start < end; vma = next) {
+    next = vma_next(mm, vma);
+    uint64_t lo = vma->vm_start > start ? vma->vm_start : start;
+    uint64_t hi = vma->vm_end < end ? vma->vm_end : end;
+    vma_unmap_pages(pgtbl, vma, lo, hi);
+
+    if (lo == vma->vm_start && hi == vma->vm_end) {
+      vma_unlink(mm, vma);
+      vma_free(vma);
+    } else if (lo == vma->vm_start) {
+      // 起始地址后移，不会越过后一个 VMA，树中的顺序不变
+      if (vma_adjust(vma, hi, vma->vm_end) != 0) {
+        return -1;
+      }
+    } else if (hi == vma->vm_end) {
+      if (vma_adjust(vma, vma->vm_start, lo) != 0) {
+        return -1;
+      }
+    } else {
+      // 从中间解除映射，把 vma 拆成两个
+      struct vm_area_struct *tail = vma_alloc(hi, vma->vm_end, vma->vm_flags);
+      if (tail == NULL) {
+        return -1;
+      }
+      copy_resident(tail, vma);
+      if (vma_adjust(vma, vma->vm_start, lo) != 0) {
+        vma_free(tail);
+        return -1;
+      }
+      vma_link(mm, tail);
+    }
+  }
+  return 0;
+}
+
+void exit_mmap(struct mm_struct *mm, uint64_t pgtbl) {
+  struct vm_area_struct *vma, *tmp;
+  list_for_each_entry_safe(vma, tmp, &mm->vm->vm_list, vm_list) {
+    vma_unmap_pages(pgtbl, vma, vma->vm_start, vma->vm_end);
+    list_del(&(vma->vm_list));
+    vma_free(vma);
+  }
+  mm->mmap_root = NULL;
+  mm->mmap_cache = NULL;
+  mm->map_count = 0;
+}
+
+int dup_mmap(struct mm_struct *dst, uint64_t dst_pgtbl,
+             struct mm_struct *src, uint64_t src_pgtbl) {
+  struct vm_area_struct *vma;
+  // 按地址顺序复制，每次都插入到链表尾部
+  list_for_each_entry(vma, &src->vm->vm_list, vm_list) {
+    struct vm_area_struct *copy =
+        vma_alloc(vma->vm_start, vma->vm_end, vma->vm_flags);
+    if (copy == NULL) {
+      return -1;
+    }
+    copy_resident(copy, vma);
+    vma_link(dst, copy);
+
+    uint64_t nr_pages = vma_nr_pages(vma);
+    for (uint64_t i = 0; i < nr_pages; i++) {
+      if (page_resident(vma, i)) {
+        copy_user_range(dst_pgtbl, src_pgtbl, vma_page_addr(vma, i),
+                        vma_page_addr(vma, i) + PAGE_SIZE);
+      }
+    }
+  }
+  return 0;
+}
+
+// 为 vma 的第 idx 个页面分配一个清零的物理页面并建立映射
+static int map_vma_page(uint64_t pgtbl, struct vm_area_struct *vma,
+                        uint64_t idx) {
+  uint64_t pa = alloc_user_pages(1, GFP_ZERO);
+  if (pa == 0) {
+    return -1;
+  }
+  create_mapping((uint64_t *)pgtbl, vma_page_addr(vma, idx), pa, PAGE_SIZE,
+                 vma->vm_flags);
+  set_resident(vma, idx);
+  return 0;
+}
+
+static bool vma_permits(struct vm_area_struct *vma, uint64_t cause) {
+  // The vma must be PTE_X/R/W according to the faulting cause,
+  // and also be PTE_V, PTE_U
+  uint64_t flags = vma->vm_flags;
+  if (!(flags & PTE_V) || !(flags & PTE_U)) {
+    return 0;
+  }
+  return ((flags & PTE_X) && cause == CAUSE_FETCH_PAGE_FAULT) ||
+         ((flags & PTE_R) && cause == CAUSE_LOAD_PAGE_FAULT) ||
+         ((flags & PTE_R) && (flags & PTE_W) &&
+          cause == CAUSE_STORE_PAGE_FAULT);
+}
+
+int handle_mm_fault(uint64_t addr, uint64_t cause) {
+  uint64_t pgtbl = SATP_PGTBL(current->satp);
+
+  // 用户地址范围以外的页表与内核共享，不能在其中建立映射
+  if (addr >= USER_MMAP_END) {
+    printf("Unhandled page fault! addr = 0x%016lx\n", addr);
+    return -1;
+  }
+
+  // 写入 fork 后共享的只读页面，复制该页面后重新执行写入指令
+  if (cause == CAUSE_STORE_PAGE_FAULT && do_cow_fault(pgtbl, addr) == 0) {
+    return 0;
+  }
+
+  struct vm_area_struct *vma = find_vma(&current->mm, addr);
+  if (vma == NULL) {
+    printf("Unhandled page fault! addr = 0x%016lx\n", addr);
+    return -1;
+  }
+  if (!vma_permits(vma, cause)) {
+    printf("Invalid permission! scause: %llx flags: %llx \n", cause,
+           vma->vm_flags);
+    return -1;
+  }
+
+  uint64_t idx = vma_page_index(vma, addr);
+  if (page_resident(vma, idx)) {
+    // 页面已经映射却仍然缺页，只可能是写时复制时分配页面失败
+    printf("alloc_pages failed!\n");
+    return -1;
+  }
+  if (map_vma_page(pgtbl, vma, idx) != 0) {
+    printf("alloc_pages failed!\n");
+    return -1;
+  }
+
+  // fault-around：窗口按虚拟地址对齐，窗口内的其他页面尽力而为，分配失败时直接放弃
+  if (fault_around_pages > 1) {
+    uint64_t nr_pages = vma_nr_pages(vma);
+    uint64_t offset = (addr / PAGE_SIZE) % fault_around_pages;
+    uint64_t first = idx > offset ? idx - offset : 0;
+    uint64_t last = idx + fault_around_pages - offset;
+    for (uint64_t i = first; i < last && i < nr_pages; i++) {
+      if (!page_resident(vma, i) && map_vma_page(pgtbl, vma, i) != 0) {
+        break;
+      }
+    }
+  }
+  return 0;
+}
@@ -1,6 +1,10 @@
 #include "defs.h"
+#include "spinlock.h"
 #include "stdio.h"
 
+// 多个 hart 同时输出时，每次 printf 的内容整行输出，不会交错在一起
+static spinlock_t print_lock = SPINLOCK_INIT;
+
 int putchar(const char c) {
   *UART16550A_DR = (unsigned char)(c);
   return (unsigned char)c;
@@ -124,7 +128,9 @@ int printf(const char *s, ...) {
   int res = 0;
   va_list vl;
   va_start(vl, s);
+  spin_lock(&print_lock);
   res = vprintfmt(putchar, s, vl);
+  spin_unlock(&print_lock);
   va_end(vl);
   return res;
 }
\ No newline at end of file
@@ -1,62 +1,412 @@
 #include "sched.h"
 #include "defs.h"
+#include "dtb.h"
+#include "fpu.h"
 #include "mm.h"
+#include "smp.h"
 #include "task_manager.h"
+#include "timer.h"
+#include "vm.h"
 
-// If next==current,do nothing; else update current and call __switch_to.
+static struct runqueue runqueues[NR_CPUS];
+
+#define cpu_rq(cpu) (&runqueues[cpu])
+#define this_rq() cpu_rq(smp_processor_id())
+
+// 进程切换出去后的这段时间内，原来的 hart 上还留有它的缓存行和 TLB 项，
+// 迁移到其他 hart 要重新加载，空闲的 hart 不窃取这样的进程
+#define MIGRATION_COST_US 500
+
+static uint64_t migration_cost;
+
+void sched_init(void) {
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    struct runqueue *rq = cpu_rq(cpu);
+    spin_lock_init(&rq->lock);
+    for (int i = 0; i < MAX_PRIO; i++) {
+      INIT_LIST_HEAD(&rq->queue[i]);
+    }
+    rq->bitmap = 0;
+    rq->nr_running = 0;
+    rq->idle = NULL;
+  }
+  migration_cost = boot_info.timebase_freq / 1000000 * MIGRATION_COST_US;
+  init_idle();
+}
+
+void init_idle(void) {
+  // 启动栈的栈底就是 tp 指向的 task_struct，cpu 字段已经由 head.S 填好
+  struct task_struct *idle = current;
+  idle->state = TASK_RUNNING;
+  idle->counter = 0;
+  idle->priority = MAX_PRIO;
+  idle->pid = -1;
+  idle->on_cpu = 1;
+  idle->parent = NULL;
+  // 空闲进程没有用户空间，使用内核页表
+  idle->satp = MAKE_SATP(kernel_pgtbl, 0);
+  // S 模式下 sscratch 为 0，trap_s 据此判断陷入来自 S 模式
+  write_csr(sscratch, 0);
+  INIT_LIST_HEAD(&idle->run_list);
+  INIT_LIST_HEAD(&idle->children);
+
+  struct runqueue *rq = this_rq();
+  rq->idle = idle;
+  rq->curr = idle;
+  rq->start_time = rdtime();
+  rq->idle_start = rq->start_time;
+  rq->idle_time = 0;
+}
+
+int select_task_rq(void) {
+  int best = smp_processor_id();
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    if (cpu_online(cpu) &&
+        READ_ONCE(cpu_rq(cpu)->nr_running) < READ_ONCE(cpu_rq(best)->nr_running)) {
+      best = cpu;
+    }
+  }
+  return best;
+}
+
+static inline bool task_on_rq(struct task_struct *p) {
+  return !list_empty(&p->run_list);
+}
+
+// 通知一个在 wfi 中的空闲 hart（不是 busy，也不是自己）来窃取 busy 上多出来的进程
+static void kick_idle_cpu(int busy) {
+  int this_cpu = smp_processor_id();
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    if (cpu == busy || cpu == this_cpu || !cpu_online(cpu)) {
+      continue;
+    }
+    struct runqueue *rq = cpu_rq(cpu);
+    if (READ_ONCE(rq->curr) == rq->idle && READ_ONCE(rq->nr_running) == 0) {
+      smp_send_reschedule(cpu);
+      return;
+    }
+  }
+}
+
+void enqueue_task(struct task_struct *p) {
+  struct runqueue *rq = cpu_rq(p->cpu);
+
+  spin_lock(&rq->lock);
+  list_add_tail(&p->run_list, &rq->queue[p->priority]);
+  rq->bitmap |= 1UL << p->priority;
+  unsigned long nr_running = ++rq->nr_running;
+  bool idle = rq->curr == rq->idle;
+  spin_unlock(&rq->lock);
+
+  // 有了第二个可运行的进程，需要重新开始 tick；时钟中断只能由该 hart 自己设置。
+  // 其他 hart 在空闲进程中时可能正停在 wfi 里，同样需要通知它
+  if (p->cpu == smp_processor_id()) {
+    if (nr_running == 2) {
+      timer_reprogram();
+    }
+  } else if (nr_running == 2 || idle) {
+    smp_send_reschedule(p->cpu);
+  }
+  if (nr_running >= 2) {
+    kick_idle_cpu(p->cpu);
+  }
+}
+
+// 调用者持有 rq->lock
+static void __dequeue_task(struct runqueue *rq, struct task_struct *p) {
+  list_del_init(&p->run_list);
+  if (list_empty(&rq->queue[p->priority])) {
+    rq->bitmap &= ~(1UL << p->priority);
+  }
+  rq->nr_running--;
+}
+
+void dequeue_task(struct task_struct *p) {
+  struct runqueue *rq = cpu_rq(p->cpu);
+
+  spin_lock(&rq->lock);
+  if (task_on_rq(p)) {
+    __dequeue_task(rq, p);
+  }
+  spin_unlock(&rq->lock);
+}
+
+bool sched_need_tick(void) {
+  return this_rq()->nr_running > 1;
+}
+
+void set_task_prio(struct task_struct *p, long prio) {
+  if (prio >= MAX_PRIO) {
+    prio = MAX_PRIO - 1;
+  }
+  if (task_on_rq(p)) {
+    dequeue_task(p);
+    p->priority = prio;
+    enqueue_task(p);
+  } else {
+    p->priority = prio;
+  }
+}
+
+// 调用者持有 rq->lock
+static struct task_struct *__pick_next_task(struct runqueue *rq,
+                                            struct task_struct *skip) {
+  uint64_t bitmap = rq->bitmap;
+  while (bitmap) {
+    int prio = __builtin_ctzl(bitmap);
+    struct task_struct *p;
+    list_for_each_entry(p, &rq->queue[prio], run_list) {
+      if (p != skip) {
+        return p;
+      }
+    }
+    bitmap &= bitmap - 1;
+  }
+  return NULL;
+}
+
+struct task_struct *pick_next_task(struct task_struct *skip) {
+  struct runqueue *rq = this_rq();
+  spin_lock(&rq->lock);
+  struct task_struct *p = __pick_next_task(rq, skip);
+  spin_unlock(&rq->lock);
+  return p;
+}
+
+static bool can_migrate_task(struct task_struct *p, int src, uint64_t now) {
+  // 正在 src 上运行，或者已经被 src 选中、还没有完成切换
+  if (p->on_cpu) {
+    return 0;
+  }
+  // 地址空间上一次就在 src 上运行，而且刚刚切换出去
+  if (p->mm.last_cpu == src && now - p->last_ran < migration_cost) {
+    return 0;
+  }
+  return 1;
+}
+
+// 调用者持有 rq->lock。优先级从高到低、每条队列从队尾开始找：
+// 队尾的进程离下一次在 src 上运行最远，迁移后得到的好处最大
+static struct task_struct *__pick_migrate_task(struct runqueue *rq, int src) {
+  uint64_t now = rdtime();
+  uint64_t bitmap = rq->bitmap;
+  while (bitmap) {
+    int prio = __builtin_ctzl(bitmap);
+    struct task_struct *p;
+    list_for_each_entry_reverse(p, &rq->queue[prio], run_list) {
+      if (can_migrate_task(p, src, now)) {
+        return p;
+      }
+    }
+    bitmap &= bitmap - 1;
+  }
+  return NULL;
+}
+
+bool idle_balance(void) {
+  int this_cpu = smp_processor_id();
+  int busiest = -1;
+  unsigned long max_load = 1;
+
+  // 不加锁地比较队列长度，只有一个可运行进程的 hart 没有可以窃取的进程
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    if (cpu == this_cpu || !cpu_online(cpu)) {
+      continue;
+    }
+    unsigned long load = READ_ONCE(cpu_rq(cpu)->nr_running);
+    if (load > max_load) {
+      max_load = load;
+      busiest = cpu;
+    }
+  }
+  if (busiest < 0) {
+    return 0;
+  }
+
+  struct runqueue *src = cpu_rq(busiest);
+  spin_lock(&src->lock);
+  struct task_struct *p = __pick_migrate_task(src, busiest);
+  if (p) {
+    __dequeue_task(src, p);
+  }
+  spin_unlock(&src->lock);
+  if (p == NULL) {
+    return 0;
+  }
+
+  // p 可运行但不在任何队列中，也不在运行，其他 hart 不会访问它的 cpu 字段
+  p->cpu = this_cpu;
+  enqueue_task(p);
+  return 1;
+}
+
+void sleep_on(struct wait_queue_head *wq, spinlock_t *lock) {
+  struct wait_queue_entry wait = {.task = current};
+
+  list_add_tail(&wait.entry, &wq->head);
+  current->state = TASK_INTERRUPTIBLE;
+  dequeue_task(current);
+  spin_unlock(lock);
+
+  // 在 schedule 之前被唤醒时已经回到了本 hart 的运行队列，schedule 仍可能选中别的进程，
+  // 但不会丢失这次唤醒；否则本 hart 运行其他进程或空闲进程，直到 wake_up
+  schedule(0);
+
+  spin_lock(lock);
+}
+
+void wake_up(struct wait_queue_head *wq) {
+  struct wait_queue_entry *wait, *tmp;
+
+  list_for_each_entry_safe(wait, tmp, &wq->head, entry) {
+    list_del(&wait->entry);
+    wait->task->state = TASK_RUNNING;
+    enqueue_task(wait->task);
+  }
+}
+
+void schedule_tail(struct task_struct *prev) {
+  // 已经退出的 prev 不会再运行，这是它最后一次切换出去
+  bool exited = prev->state == TASK_ZOMBIE || prev->state == TASK_DEAD;
+
+  // 从此以后不再使用 prev 的内核栈
+  smp_mb();
+  WRITE_ONCE(prev->on_cpu, 0);
+
+  // 放下调度器持有的引用，父进程已经回收时在这里释放 prev
+  if (exited) {
+    spin_lock(&tasklist_lock);
+    put_task_struct(prev);
+    spin_unlock(&tasklist_lock);
+  }
+}
+
+// If next==current,do nothing; else switch the address space and call
+// __switch_to, which also moves tp to next.
 void switch_to(struct task_struct *next) {
   if (current != next) {
     struct task_struct *prev = current;
-    current = next;
-    __switch_to(prev, next);
+    next->cpu = prev->cpu;
+    prev->last_ran = rdtime();
+    fp_switch(prev, next);
+    switch_mm(next);
+    prev = __switch_to(prev, next);
+    schedule_tail(prev);
   }
 }
 
 void call_first_process() {
-  current = (struct task_struct*)alloc_page();
-  current->pid = -1;
-  current->counter = 0;
-  current->priority = 0;
+  // 当前上下文就是本 hart 的空闲进程，切换出去后在 dead_loop 中等待新的进程
   schedule(0);
 }
 
 void do_timer(void) {
+  struct runqueue *rq = this_rq();
+  // 空闲进程不参与时间片轮转，回到 dead_loop 后会检查运行队列
+  if (current == rq->idle) {
+    return;
+  }
+  if (--current->counter > 0) {
+    return;
+  }
+  current->counter = task_timeslice(current);
+  // 排队的进程上次没有被窃取可能是因为缓存还热，现在再让空闲的 hart 试一次
+  if (READ_ONCE(rq->nr_running) > 1) {
+    kick_idle_cpu(smp_processor_id());
+  }
+  // 当前进程移到队尾；同优先级没有其他进程时 schedule 会继续选中它
+  schedule(1);
 }
 
-// Select the next task to run. If all tasks are done(counter=0), set task0's
-// counter to 1 and it would assign new test case.
+// Select the next task to run on this hart: the head of the highest priority
+// queue. The current task goes to the tail of its queue first, so tasks of the
+// same priority take turns. Unless self is set, current is not picked again
+// even if it is the only task of the highest priority. When nothing else is
+// runnable, a runnable current keeps running and otherwise the hart switches
+// to its idle task, after trying to steal a task from a busier hart.
 void schedule(bool self) {
-  unsigned char next = NR_TASKS;
+  struct runqueue *rq = this_rq();
 
-  // DONE
-  int min = 0x7fffffff;
-  int min_p = 0x7fffffff;
-  for (int i = NR_TASKS - 1; i >= 0; i--) {
-    if (task[i] == 0x0) {
-      continue;
+  // current has gone to sleep or exited and nothing else is queued here
+  if (READ_ONCE(rq->nr_running) == 0) {
+    idle_balance();
+  }
+
+  spin_lock(&rq->lock);
+  if (task_on_rq(current)) {
+    list_move_tail(&current->run_list, &rq->queue[current->priority]);
+  }
+  struct task_struct *next = __pick_next_task(rq, self ? NULL : current);
+  if (next == NULL) {
+    next = task_on_rq(current) ? current : rq->idle;
+  }
+  next->on_cpu = 1;
+  if (next != rq->curr) {
+    uint64_t now = rdtime();
+    if (rq->curr == rq->idle) {
+      rq->idle_time += now - rq->idle_start;
+    } else if (next == rq->idle) {
+      rq->idle_start = now;
     }
-    if (!self && task[i] == current) {
+    rq->curr = next;
+  }
+  spin_unlock(&rq->lock);
+
+  switch_to(next);
+}
+
+int get_cpu_stat(struct cpu_stat *stat, int n) {
+  if (n < 0) {
+    n = 0;
+  }
+  if (n > NR_CPUS) {
+    n = NR_CPUS;
+  }
+  for (int cpu = 0; cpu < n; cpu++) {
+    struct runqueue *rq = cpu_rq(cpu);
+    stat[cpu].idle = 0;
+    stat[cpu].busy = 0;
+    if (!cpu_online(cpu)) {
       continue;
     }
-    if (task[i]->priority < min_p && task[i]->counter > 0) {
-      min_p = task[i]->priority;
-      min = task[i]->counter;
-      next = i;
-    } else if (task[i]->priority == min_p && task[i]->counter < min &&
-               task[i]->counter > 0) {
-      min = task[i]->counter;
-      next = i;
+    spin_lock(&rq->lock);
+    uint64_t now = rdtime();
+    uint64_t idle = rq->idle_time;
+    if (rq->curr == rq->idle) {
+      idle += now - rq->idle_start;
     }
+    stat[cpu].idle = idle;
+    stat[cpu].busy = now - rq->start_time - idle;
+    spin_unlock(&rq->lock);
   }
+  return n;
+}
 
-  if (next == NR_TASKS) {
-    return;
+// S 模式下 sstatus.SIE 始终为 0，trap_s 只能处理来自 U 模式的 trap。
+// wfi 不受 SIE 影响，sie 中使能的中断（时钟、核间中断）一旦待处理就返回，
+// 醒来后由这里直接调用对应的处理函数；检查运行队列之后到来的中断也会让 wfi 立即返回
+static void cpu_idle(void) {
+  asm volatile("wfi");
+  unsigned long sip = read_csr(sip);
+  if (sip & SIP_STIP) {
+    timer_interrupt();
+  }
+  if (sip & SIP_SSIP) {
+    smp_ipi_interrupt();
   }
-
-  switch_to(task[next]);
 }
 
 void dead_loop() {
+  struct runqueue *rq = this_rq();
   while (1) {
+    if (READ_ONCE(rq->nr_running) > 0 || idle_balance()) {
+      schedule(0);
+      continue;
+    }
+    // 空闲时为缺页和页表分配预先准备清零的页面，补满之后再睡眠
+    refill_zero_pool(ZERO_POOL_SIZE);
+    if (READ_ONCE(rq->nr_running) == 0) {
+      cpu_idle();
+    }
   }
 }
@@ -2,20 +2,33 @@
 
 #include "mm.h"
 #include "stddef.h"
+#include "stdio.h"
 
 enum { PAGE_FREE, PAGE_BUDDY, PAGE_SLUB, PAGE_RESERVE };
 
 struct cache_area cache_region;
-unsigned long cache_tid = 0;
 
 struct kmem_cache *slub_allocator[NR_PARTIAL] = {};
+LIST_HEAD(slab_caches);
 void *page_base;
+// page_base[0] 对应的物理页面，即 buddy system 管理的第一个页面
+uint64_t page_base_pa;
 
-const size_t kmem_cache_objsize[] = {8, 16, 32, 64, 128, 256, 512, 1024, 2048};
+// 96 and 192 sit between the powers of two where small objects cluster, and
+// 3072 keeps 2K-3K objects from taking a whole 4K page.
+const size_t kmem_cache_objsize[] = {8,   16,  32,  64,   96,   128,
+                                     192, 256, 512, 1024, 2048, 3072};
 const char *kmem_cache_name[] = {
     "slub-objectsize-8   ", "slub-objectsize-16  ", "slub-objectsize-32  ",
-    "slub-objectsize-64  ", "slub-objectsize-128 ", "slub-objectsize-256 ",
-    "slub-objectsize-512 ", "slub-objectsize-1024", "slub-objectsize-2048"};
+    "slub-objectsize-64  ", "slub-objectsize-96  ", "slub-objectsize-128 ",
+    "slub-objectsize-192 ", "slub-objectsize-256 ", "slub-objectsize-512 ",
+    "slub-objectsize-1024", "slub-objectsize-2048", "slub-objectsize-3072"};
+
+// Class of sizes up to 192, indexed by (size - 1) / 8.
+static const uint8_t size_index[24] = {
+    0, 1, 2, 2, 3, 3, 3, 3,  /* 8, 16, 24-32, 40-64 */
+    4, 4, 4, 4, 5, 5, 5, 5,  /* 72-96, 104-128 */
+    6, 6, 6, 6, 6, 6, 6, 6}; /* 136-192 */
 
 #define IS_POWER_OF_2(x) (((x) & ((x)-1)))
 #define ALIGN_SIZE(size, aligns) (((size - 1) / aligns + 1) * aligns)
@@ -24,19 +37,40 @@ const char *kmem_cache_name[] = {
   (size < PAGE_SIZE ? 4 : ((size / PAGE_SIZE) + 1) * 4)
 #define ADDR_TO_PAGE(addr)                                            \
   ((struct page *)(page_base +                                        \
-                   (((PHYSICAL_ADDR((unsigned long)addr) - PHYSICAL_ADDR((uint64_t)&_end)) & PAGE_MASK) >> \
+                   (((PHYSICAL_ADDR((unsigned long)addr) - page_base_pa) & PAGE_MASK) >> \
                     PAGE_SHIFT) *                                     \
                        STRUCT_PAGE_SIZE))
+/*
+ * Each cpu starts its tid at its own number and advances it by TID_STEP, so
+ * tids are unique across cpus. Every change of a cpu freelist bumps the tid,
+ * which makes a stale cmpxchg fail even if the head object is the same.
+ */
+#define TID_STEP NR_CPUS
+#define FREELIST_TID(freelist, tid) \
+  (((uint64_t)(tid) << 32) | ((uint64_t)(freelist) & 0xffffffffUL))
+#define TID_OF(ft) ((uint32_t)((ft) >> 32))
+#define FREELIST_OF(ft) ((void **)((ft) & 0xffffffffUL))
+#define NEXT_FREELIST_TID(ft, freelist) \
+  FREELIST_TID(freelist, TID_OF(ft) + TID_STEP)
+
+// The free pointer of an object lives at s->offset: at the start of the
+// object normally, after it for caches with a constructor so that a free
+// object keeps its constructed state.
+static inline void *get_freepointer(struct kmem_cache *s, void *object) {
+  return *(void **)((char *)object + s->offset);
+}
+
+static inline void set_freepointer(struct kmem_cache *s, void *object,
+                                   void *fp) {
+  *(void **)((char *)object + s->offset) = fp;
+}
+
 #define PAGE_TO_ADDR(page_addr)                                            \
   ((uint64_t)((((page_addr - page_base) / STRUCT_PAGE_SIZE) << PAGE_SHIFT) + \
-            PHYSICAL_ADDR((uint64_t)&_end)))
+            page_base_pa))
 
-void *memset(void *dst, int c, uint32_t n) {
-  char *cdst = (char *)dst;
-  for (int i = 0; i < n; i++) {
-    cdst[i] = c;
-  }
-  return dst;
+struct page *addr_to_page(uint64_t addr) {
+  return ADDR_TO_PAGE(addr);
 }
 
 void set_page_attr(void *addr, int nr, int attr) {
@@ -103,15 +137,15 @@ void *init_object_list(void *addr, size_t objsize, size_t size) {
 void page_init() {
   size_t page_size;
 
-  page_size = (1UL << (MEM_SHIFT - PAGE_SHIFT)) * STRUCT_PAGE_SIZE;
+  // buddy system 管理的每个页面对应一个 struct page，page_size 为数组所占的页面数
+  page_base_pa = buddy_base_addr();
+  page_size = (buddy_nr_pages() * STRUCT_PAGE_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
 
   page_base = (void*)(alloc_pages(page_size));
   if (page_base == NULL)
     while (1)
       ;
 
-  memset(page_base, 0, page_size << PAGE_SHIFT);
-
   set_page_attr(page_base, page_size, PAGE_RESERVE);
 }
 
@@ -160,41 +194,127 @@ void *cache_create(const char *name, size_t size, unsigned int aligns,
   s->refcount = 1;
 
   s->min_partial = 4;
-  s->size = ALIGN_SIZE(size, aligns);
-  s->size = s->size < 8 ? 8 : s->size;
   s->object_size = size;
-  s->offset = 0;
+  if (func != NULL) {
+    s->offset = ALIGN_SIZE(size, sizeof(void *));
+    s->size = ALIGN_SIZE(s->offset + sizeof(void *), aligns);
+  } else {
+    s->offset = 0;
+    s->size = ALIGN_SIZE(size, aligns);
+    s->size = s->size < 8 ? 8 : s->size;
+  }
   s->inuse = 0;
   s->align = aligns;
   INIT_LIST_HEAD(&(s->list));
   s->nr_page_per_slub = GET_NR_PAGE_PER_SLUB(s->size);
+  s->objects = (s->nr_page_per_slub << PAGE_SHIFT) / s->size;
 
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    s->cpu_slab[cpu].freelist_tid = FREELIST_TID(NULL, cpu);
+    s->cpu_slab[cpu].page = NULL;
+  }
+
+  spin_lock_init(&(s->list_lock));
   s->nr_partial = 0;
+  INIT_LIST_HEAD(&(s->partial));
+  INIT_LIST_HEAD(&(s->full));
+  s->nr_free = 0;
+  INIT_LIST_HEAD(&(s->free));
+  s->nr_slabs = 0;
 
-  s->tid = cache_tid++;
   return s;
 }
 
-void *cache_alloc_pages(struct kmem_cache *cache) {
+// Allocate a new slab. It is not on any list and all its objects are on
+// page->freelist. Called without list_lock: the buddy allocator may run the
+// shrinkers, which take list_lock of every cache.
+static struct page *cache_alloc_pages(struct kmem_cache *cache) {
   void *p;
-  void *tp;
   struct page *page;
 
-  p = (void*)(alloc_pages(cache->nr_page_per_slub));
+  // 对象由构造函数或调用者初始化，slab 页面无需预先清零
+  p = (void*)(alloc_pages_flags(cache->nr_page_per_slub, GFP_KERNEL));
   if (p == NULL) return NULL;
 
-  memset(p, 0, (cache->nr_page_per_slub) << PAGE_SHIFT);
   set_page_attr(p, cache->nr_page_per_slub, PAGE_SLUB);
-  tp = init_object_list(p, cache->size,
-                        ((cache->nr_page_per_slub) << PAGE_SHIFT));
-  cache->freelist = p;
+  // 构造函数只在 slab 建立时对每个对象运行一次
+  for (unsigned int i = 0; i < cache->objects; i++) {
+    char *object = (char *)p + i * cache->size;
+    if (cache->init_func != NULL) cache->init_func(object);
+    set_freepointer(cache, object,
+                    i + 1 < cache->objects ? object + cache->size : NULL);
+  }
   page = ADDR_TO_PAGE(p);
   page->slub = cache;
+  page->freelist = p;
+  page->count = 0;
   INIT_LIST_HEAD(&(page->slub_list));
-  list_add_tail(&(cache->list), &(page->slub_list));
-  cache->nr_partial++;
 
-  return p;
+  return page;
+}
+
+// Return the pages of an empty slab to the buddy system.
+static void cache_free_pages(struct kmem_cache *cache, struct page *page) {
+  list_del_init(&(page->slub_list));
+  free_pages(PAGE_TO_ADDR((void *)page));
+  clear_page_attr(page);
+  cache->nr_slabs--;
+}
+
+static inline struct kmem_cache_cpu *this_cpu_slab(struct kmem_cache *s) {
+  return &(s->cpu_slab[smp_processor_id()]);
+}
+
+// A slab is frozen while it is some cpu's cpu slab; it is then on no list.
+static inline bool slab_frozen(struct page *page) {
+  return list_empty(&(page->slub_list));
+}
+
+// Make @page the cpu slab of @c: its free objects move to the cpu freelist and
+// the slab is frozen, i.e. page->count stays at cache->objects while it is
+// active. Called with list_lock held and interrupts off.
+static void activate_slab(struct kmem_cache *cache, struct kmem_cache_cpu *c,
+                          struct page *page) {
+  list_del_init(&(page->slub_list));
+  page->count = cache->objects;
+  // The free fast path reads the tid before c->page, so publish the page
+  // first: a free that sees the new page also sees the new tid.
+  c->page = page;
+  barrier();
+  c->freelist_tid = NEXT_FREELIST_TID(c->freelist_tid, page->freelist);
+  page->freelist = NULL;
+}
+
+// Refill the empty cpu freelist of @c. Objects freed into the cpu slab by other
+// cpus sit on page->freelist and are taken first. Otherwise the cpu slab has
+// handed out every object and becomes full, and the next slab is the first
+// partial slab, then a kept empty slab. Fails if the cache has to grow. Called
+// with list_lock held and interrupts off.
+static int refill_freelist(struct kmem_cache *cache, struct kmem_cache_cpu *c) {
+  struct page *page = c->page;
+
+  if (page != NULL) {
+    if (page->freelist != NULL) {
+      c->freelist_tid = NEXT_FREELIST_TID(c->freelist_tid, page->freelist);
+      page->freelist = NULL;
+      return 0;
+    }
+    list_add(&(page->slub_list), &(cache->full));
+    c->page = NULL;
+  }
+
+  if (!list_empty(&(cache->partial))) {
+    page = list_first_entry(&(cache->partial), struct page, slub_list);
+    cache->nr_partial--;
+  } else if (!list_empty(&(cache->free))) {
+    page = list_first_entry(&(cache->free), struct page, slub_list);
+    cache->nr_free--;
+  } else {
+    return -1;
+  }
+
+  activate_slab(cache, c, page);
+  return 0;
 }
 
 static void inline free_slub_structure(struct kmem_cache *cache) {
@@ -208,9 +328,33 @@ static void inline free_slub_structure(struct kmem_cache *cache) {
   return;
 }
 
+// Shrinker: release the empty slabs kept on the free lists, including the
+// min_partial ones kept for reuse. Cpu slabs are left alone.
+static unsigned long slub_shrink(unsigned long nr_to_scan) {
+  struct kmem_cache *s;
+  struct page *p, *t;
+  unsigned long freed = 0;
+
+  list_for_each_entry(s, &slab_caches, list) {
+    unsigned long flags = spin_lock_irqsave(&(s->list_lock));
+    list_for_each_entry_safe(p, t, &(s->free), slub_list) {
+      if (freed >= nr_to_scan) break;
+      cache_free_pages(s, p);
+      s->nr_free--;
+      freed += s->nr_page_per_slub;
+    }
+    spin_unlock_irqrestore(&(s->list_lock), flags);
+    if (freed >= nr_to_scan) break;
+  }
+  return freed;
+}
+
+static struct shrinker slub_shrinker = {.name = "slub", .scan = slub_shrink};
+
 void slub_init() {
   page_init();
   slub_structure_init();
+  register_shrinker(&slub_shrinker);
   for (int i = 0; i < NR_PARTIAL; i++) {
     slub_allocator[i] = kmem_cache_create(kmem_cache_name[i],
                                           kmem_cache_objsize[i], 8, 0, NULL);
@@ -223,113 +367,219 @@ struct kmem_cache *kmem_cache_create(const char *name, size_t size,
                                      unsigned int aligns, int flags,
                                      void *func(void *)) {
   struct kmem_cache *s = NULL;
+  struct page *page;
   const char *cache_name;
 
   s = cache_create(name, size, aligns, flags, func);
-  if (cache_alloc_pages(s) == NULL) {
+  page = cache_alloc_pages(s);
+  if (page == NULL) {
     free_slub_structure(s);
     return NULL;
-  } else {
-    return s;
   }
+  s->nr_slabs++;
+  activate_slab(s, this_cpu_slab(s), page);
+  list_add_tail(&(s->list), &slab_caches);
+  return s;
 }
 
 int kmem_cache_destroy(struct kmem_cache *s) {
-  struct list_head *l;
-  struct page *p;
-  list_for_each(l, &(s->list)) {
-    if (list_entry(l, struct page, slub_list)->count != 0) return -1;
+  struct page *p, *t;
+
+  // Every object must have been freed: no partial or full slab is left and
+  // each cpu slab has all of its objects back on a freelist.
+  if (!list_empty(&(s->partial)) || !list_empty(&(s->full))) return -1;
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    struct kmem_cache_cpu *c = &(s->cpu_slab[cpu]);
+    unsigned long nr_free_objects = 0;
+    if (c->page == NULL) continue;
+    for (void *obj = FREELIST_OF(c->freelist_tid); obj != NULL;
+         obj = get_freepointer(s, obj))
+      nr_free_objects++;
+    for (void *obj = c->page->freelist; obj != NULL;
+         obj = get_freepointer(s, obj))
+      nr_free_objects++;
+    if (nr_free_objects != s->objects) return -1;
   }
-  list_for_each(l, &(s->list)) {
-    p = list_entry(l, struct page, slub_list);
-    free_pages(PAGE_TO_ADDR((void *)p));
-    clear_page_attr(p);
+
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    if (s->cpu_slab[cpu].page != NULL) {
+      cache_free_pages(s, s->cpu_slab[cpu].page);
+    }
+  }
+  list_for_each_entry_safe(p, t, &(s->free), slub_list) {
+    cache_free_pages(s, p);
   }
+  list_del(&(s->list));
   free_slub_structure(s);
   return 0;
 }
 
-void *kmem_cache_alloc(struct kmem_cache *cache) {
-  void *object = NULL;
-  struct list_head *l;
-  struct page *p;
-
-  if (cache->freelist == NULL) {
-    list_for_each(l, &(cache->list)) {
-      p = list_entry(l, struct page, slub_list);
-      if (p->freelist != NULL) {
-        cache->freelist = p->freelist;
+// Slow path of kmem_cache_alloc: refill the cpu freelist under list_lock with
+// interrupts off, then pop one object. A new slab is allocated with list_lock
+// dropped; if the freelist got refilled meanwhile, it is kept as an empty slab.
+static void *slab_alloc_slow(struct kmem_cache *cache) {
+  void **object = NULL;
+  struct page *page;
+  unsigned long flags = spin_lock_irqsave(&(cache->list_lock));
+  struct kmem_cache_cpu *c = this_cpu_slab(cache);
+
+  // An interrupt may have refilled the freelist before interrupts were off.
+  if (FREELIST_OF(c->freelist_tid) == NULL && refill_freelist(cache, c) != 0) {
+    spin_unlock_irqrestore(&(cache->list_lock), flags);
+    page = cache_alloc_pages(cache);
+    flags = spin_lock_irqsave(&(cache->list_lock));
+    c = this_cpu_slab(cache);
+    if (page != NULL) {
+      cache->nr_slabs++;
+      if (FREELIST_OF(c->freelist_tid) == NULL &&
+          refill_freelist(cache, c) != 0) {
+        activate_slab(cache, c, page);
+      } else {
+        list_add(&(page->slub_list), &(cache->free));
+        cache->nr_free++;
       }
     }
-    if (cache->freelist == NULL && cache_alloc_pages(cache) == NULL)
-      return NULL;
   }
 
-  object = cache->freelist;
-  cache->freelist = *(cache->freelist);
-  (ADDR_TO_PAGE(object)->header)->count++;
-  if (cache->init_func != NULL)
-    cache->init_func(object);
-  else {
-    memset(object, 0, cache->size);
+  if (FREELIST_OF(c->freelist_tid) != NULL) {
+    object = FREELIST_OF(c->freelist_tid);
+    c->freelist_tid =
+        NEXT_FREELIST_TID(c->freelist_tid, get_freepointer(cache, object));
   }
+
+  spin_unlock_irqrestore(&(cache->list_lock), flags);
   return object;
 }
 
-void kmem_cache_free(void *obj) {
-  struct page *page = ADDR_TO_PAGE(obj)->header;
-  struct kmem_cache *s;
-  void *p;
+void *kmem_cache_alloc(struct kmem_cache *cache) {
+  struct kmem_cache_cpu *c = this_cpu_slab(cache);
+  void **object;
+  uint64_t ft;
+
+  // Fast path: pop the cpu freelist without locks or disabling interrupts.
+  // If an interrupt handler allocates or frees on this cpu in between, the
+  // tid has moved on and the cmpxchg fails, even when the head object is the
+  // same again. The free pointer read may then be stale, but it is never used.
+  do {
+    ft = READ_ONCE(c->freelist_tid);
+    object = FREELIST_OF(ft);
+    if (object == NULL) {
+      object = slab_alloc_slow(cache);
+      if (object == NULL) return NULL;
+      break;
+    }
+  } while (cmpxchg64(&(c->freelist_tid), ft,
+                     NEXT_FREELIST_TID(ft, get_freepointer(cache, object))) !=
+           ft);
 
-  s = page->slub;
-  if (page->freelist == NULL) {
-    page->freelist = obj;
-  } else {
-    *((void **)obj) = *(void **)(page->freelist);
-    *(void **)(page->freelist) = (void *)obj;
+  // The object is not cleared: it is either constructed or garbage, callers
+  // that need zeroed memory use kzalloc.
+  return object;
+}
+
+// Slow path of kmem_cache_free: the object is not in this cpu's cpu slab.
+static void slab_free_slow(struct kmem_cache *s, struct page *page, void *obj) {
+  unsigned long flags = spin_lock_irqsave(&(s->list_lock));
+
+  set_freepointer(s, obj, page->freelist);
+  page->freelist = obj;
+
+  // The cpu slab of another cpu: its owner picks the object up when its cpu
+  // freelist runs dry.
+  if (slab_frozen(page)) {
+    spin_unlock_irqrestore(&(s->list_lock), flags);
+    return;
   }
-  page = page->header;
+
+  bool was_full = page->count == s->objects;
   page->count--;
-  if (page->count == 0 && s->nr_partial > s->min_partial) {
-    free_pages((uint64_t)obj);
-    clear_page_attr(page);
-    s->nr_partial--;
+
+  if (page->count == 0) {
+    // Keep up to min_partial empty slabs so that alloc/free at a slab
+    // boundary does not bounce pages to the buddy system.
+    list_del_init(&(page->slub_list));
+    if (!was_full) s->nr_partial--;
+    if (s->nr_free < s->min_partial) {
+      list_add(&(page->slub_list), &(s->free));
+      s->nr_free++;
+    } else {
+      cache_free_pages(s, page);
+    }
+  } else if (was_full) {
+    list_move(&(page->slub_list), &(s->partial));
+    s->nr_partial++;
   }
 
-  return;
+  spin_unlock_irqrestore(&(s->list_lock), flags);
 }
 
-void *kmalloc(size_t size) {
+void kmem_cache_free(void *obj) {
+  struct page *page = ADDR_TO_PAGE(obj)->header;
+  struct kmem_cache *s = page->slub;
+  struct kmem_cache_cpu *c = this_cpu_slab(s);
+  uint64_t ft;
+
+  // Fast path: objects of this cpu's cpu slab go straight back to the cpu
+  // freelist. The tid is read before c->page; if the cpu slab changes after
+  // that, the tid changes too and the cmpxchg fails.
+  do {
+    ft = READ_ONCE(c->freelist_tid);
+    barrier();
+    if (READ_ONCE(c->page) != page) {
+      slab_free_slow(s, page, obj);
+      return;
+    }
+    set_freepointer(s, obj, FREELIST_OF(ft));
+  } while (cmpxchg64(&(c->freelist_tid), ft, NEXT_FREELIST_TID(ft, obj)) != ft);
+}
+
+// Index of the kmalloc cache for @size in O(1), or -1 if @size is served by
+// the buddy system.
+static int kmalloc_index(size_t size) {
+  if (size <= 192) return size_index[(size - 1) / 8];
+  // 256 ... 2048: the class is given by the highest set bit of size - 1
+  if (size <= 2048) return (64 - __builtin_clzl(size - 1)) - 1;
+  if (size <= 3072) return NR_PARTIAL - 1;
+  return -1;
+}
+
+static void *__kmalloc(size_t size, unsigned int flags) {
   int objindex;
+  unsigned int nr;
   void *p = NULL;
 
   if (size == 0) return NULL;
 
-  // TODO:
-  // 1. 判断 size 是否处于 slub_allocator[objindex] 管理的范围内
-  // 2. 如果是就使用 kmem_cache_alloc 接口分配，否则使用 alloc_pages 接口分配
-  
-  // size 若在 kmem_cache_objsize 所提供的范围之内，则使用 slub allocator
-  // 来分配内存
-  for (objindex = 0; objindex < NR_PARTIAL; objindex++) {
-    if(size <= kmem_cache_objsize[objindex]) {
-      // TODO:
-      p = kmem_cache_alloc(slub_allocator[objindex]);
-      return p;
-    }
+  // 1. 用 kmalloc_index 直接查出 size 所属的 slub_allocator[objindex]
+  // 2. 如果存在就使用 kmem_cache_alloc 接口分配，否则使用 alloc_pages 接口分配
+  // 3. 只有 GFP_ZERO 时才清零，且只清零请求的 size 字节
+  objindex = kmalloc_index(size);
+  if (objindex >= 0) {
+    p = kmem_cache_alloc(slub_allocator[objindex]);
+    if (p != NULL && (flags & GFP_ZERO)) memset(p, 0, size);
+    return p;
   }
 
-  // size 若不在 kmem_cache_objsize 范围之内，则使用 buddy system 来分配内存
-  if (objindex >= NR_PARTIAL) {
-    // TODO:
-    p = alloc_pages((size - 1) / PAGE_SIZE + 1);
+  // size 若不在 kmem_cache_objsize 范围之内，则从 buddy system 分配恰好够用的页面，
+  // 页数记在首页的 count 中，kfree 时按同样的页数归还
+  nr = (size - 1) / PAGE_SIZE + 1;
+  p = (void *)alloc_pages_exact(nr, flags);
+  if (p == NULL) return NULL;
 
-    set_page_attr(p, (size - 1) / PAGE_SIZE, PAGE_BUDDY);
-  }
+  set_page_attr(p, nr, PAGE_BUDDY);
+  ADDR_TO_PAGE(p)->count = nr;
 
   return p;
 }
 
+void *kmalloc(size_t size) {
+  return __kmalloc(size, GFP_KERNEL);
+}
+
+void *kzalloc(size_t size) {
+  return __kmalloc(size, GFP_ZERO);
+}
+
 void kfree(const void *addr) {
   struct page *page;
 
@@ -342,9 +592,11 @@ void kfree(const void *addr) {
   
   if (page->flags == PAGE_BUDDY) {
     // TODO:
-    free_pages((uint64_t)addr);
-
-    clear_page_attr(ADDR_TO_PAGE(addr)->header);
+    page = page->header;
+    // 页面还给 buddy 之后可能立刻被其他 hart 分配并设置新的属性，先清除属性
+    int count = page->count;
+    clear_page_attr(page);
+    free_pages_exact(PAGE_TO_ADDR((void *)page), count);
 
   } else if (page->flags == PAGE_SLUB) {
     // TODO:
@@ -353,3 +605,36 @@ void kfree(const void *addr) {
 
   return;
 }
+
+void slub_report(void) {
+  struct kmem_cache *s;
+
+  list_for_each_entry(s, &slab_caches, list) {
+    unsigned long flags = spin_lock_irqsave(&(s->list_lock));
+    unsigned long inuse = 0;
+    struct page *page;
+
+    list_for_each_entry(page, &(s->partial), slub_list) inuse += page->count;
+    list_for_each_entry(page, &(s->full), slub_list) inuse += page->count;
+    // Objects of a cpu slab are in use unless they are on one of its freelists
+    for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+      struct kmem_cache_cpu *c = &(s->cpu_slab[cpu]);
+      if (c->page == NULL) continue;
+      inuse += s->objects;
+      for (void *obj = FREELIST_OF(c->freelist_tid); obj != NULL;
+           obj = get_freepointer(s, obj))
+        inuse--;
+      for (void *obj = c->page->freelist; obj != NULL;
+           obj = get_freepointer(s, obj))
+        inuse--;
+    }
+    unsigned long total = s->nr_slabs * s->objects;
+    unsigned long slab_bytes = s->nr_slabs * (s->nr_page_per_slub << PAGE_SHIFT);
+
+    printf("[slub] %s: %ld slabs (%ld partial, %ld empty), %ld/%ld objects in "
+           "use, %ld/%ld bytes used\n",
+           s->name, s->nr_slabs, s->nr_partial, s->nr_free, inuse, total,
+           inuse * s->size, slab_bytes);
+    spin_unlock_irqrestore(&(s->list_lock), flags);
+  }
+}
@@ -0,0 +1,86 @@
+#include "smp.h"
+
+#include "atomic.h"
+#include "dtb.h"
+#include "riscv.h"
+#include "sbi.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "stdio.h"
+#include "timer.h"
+
+// 由发送方置位，目标 hart 的 M 模式处理 IPI_TLB_FLUSH，S 模式处理其余的位
+volatile uint64_t ipi_pending[NR_CPUS];
+volatile uint64_t cpu_online_mask;
+
+// 同一时间只有一个 hart 发起 TLB 刷新，否则后来者的请求可能被之前的一次刷新确认
+static spinlock_t tlb_flush_lock = SPINLOCK_INIT;
+
+void smp_boot_secondaries(void) {
+  cpu_online_mask = 1UL << smp_processor_id();
+
+  // 逐个唤醒，等它打印完上线信息后再唤醒下一个；一秒内没有上线的 hart 不再等待
+  for (int cpu = 0; cpu < boot_info.nr_cpus; cpu++) {
+    if (cpu_online(cpu)) {
+      continue;
+    }
+    smp_mb();
+    sbi_send_ipi(1UL << cpu);
+    uint64_t deadline = rdtime() + boot_info.timebase_freq;
+    while (!cpu_online(cpu) && rdtime() < deadline)
+      ;
+    if (!cpu_online(cpu)) {
+      printf("[smp] hart %d failed to come online\n", cpu);
+    }
+  }
+  printf("[smp] %d harts online\n", __builtin_popcountl(cpu_online_mask));
+}
+
+void secondary_start_kernel(void) {
+  int cpu = smp_processor_id();
+
+  init_idle();
+  timer_init_cpu();
+  printf("[smp] hart %d online\n", cpu);
+  atomic_fetch_or64(&cpu_online_mask, 1UL << cpu);
+
+  call_first_process();
+  dead_loop();
+}
+
+void smp_send_reschedule(int cpu) {
+  atomic_fetch_or64(&ipi_pending[cpu], IPI_RESCHEDULE);
+  sbi_send_ipi(1UL << cpu);
+}
+
+void smp_flush_tlb_others(void) {
+  uint64_t mask = cpu_online_mask & ~(1UL << smp_processor_id());
+  if (mask == 0) {
+    return;
+  }
+
+  spin_lock(&tlb_flush_lock);
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    if (mask & (1UL << cpu)) {
+      atomic_fetch_or64(&ipi_pending[cpu], IPI_TLB_FLUSH);
+    }
+  }
+  sbi_send_ipi(mask);
+  // M 模式的软件中断在 S 模式下总是开启的，目标 hart 无论在做什么都会很快完成
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    while (READ_ONCE(ipi_pending[cpu]) & IPI_TLB_FLUSH)
+      ;
+  }
+  spin_unlock(&tlb_flush_lock);
+}
+
+void smp_ipi_interrupt(void) {
+  clear_csr(sip, SIP_SSIP);
+  uint64_t pending =
+      atomic_fetch_and64(&ipi_pending[smp_processor_id()], ~IPI_RESCHEDULE);
+
+  // 其他 hart 向本 hart 的运行队列加入了进程，可能需要重新开始 tick
+  if (pending & IPI_RESCHEDULE) {
+    timer_reprogram();
+  }
+}
@@ -1,9 +1,129 @@
 #include "string.h"
 
+// 内核中所有的内存/字符串操作都在这里实现。
+// 当源地址和目的地址可以同时对齐到 8 字节时，先逐字节处理到对齐边界，
+// 再以 64 位为单位、每轮展开 4 次进行处理，最后逐字节处理不足 8 字节的尾部。
+
+#define WORD_SIZE sizeof(uint64_t)
+#define WORD_MASK (WORD_SIZE - 1)
+#define UNROLL_SIZE (4 * WORD_SIZE)
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+// 当 x 的某个字节为 0 时结果非 0
+#define HAS_ZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+
+#define IS_ALIGNED(p) (((uintptr_t)(p) & WORD_MASK) == 0)
+
+void *memcpy(void *dst, const void *src, size_t n) {
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+
+    if (n >= WORD_SIZE) {
+        while (!IS_ALIGNED(d)) {
+            *d++ = *s++;
+            n--;
+        }
+
+        uint64_t *dw = (uint64_t *)d;
+        if (IS_ALIGNED(s)) {
+            const uint64_t *sw = (const uint64_t *)s;
+            while (n >= UNROLL_SIZE) {
+                uint64_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+                dw[0] = w0;
+                dw[1] = w1;
+                dw[2] = w2;
+                dw[3] = w3;
+                dw += 4;
+                sw += 4;
+                n -= UNROLL_SIZE;
+            }
+            while (n >= WORD_SIZE) {
+                *dw++ = *sw++;
+                n -= WORD_SIZE;
+            }
+            s = (const unsigned char *)sw;
+        } else {
+            // 源地址与目的地址相对错位：只做对齐的读取，再把相邻两个字移位拼接
+            unsigned int shift = ((uintptr_t)s & WORD_MASK) * 8;
+            const uint64_t *sw = (const uint64_t *)((uintptr_t)s & ~WORD_MASK);
+            uint64_t prev = *sw++;
+            size_t copied = 0;
+            while (n - copied >= WORD_SIZE) {
+                uint64_t next = *sw++;
+                *dw++ = (prev >> shift) | (next << (64 - shift));
+                prev = next;
+                copied += WORD_SIZE;
+            }
+            s += copied;
+            n -= copied;
+        }
+        d = (unsigned char *)dw;
+    }
+
+    while (n--) {
+        *d++ = *s++;
+    }
+    return dst;
+}
+
+void *memset(void *dst, int c, size_t n) {
+    unsigned char *d = dst;
+
+    if (n >= WORD_SIZE) {
+        while (!IS_ALIGNED(d)) {
+            *d++ = (unsigned char)c;
+            n--;
+        }
+
+        uint64_t w = (unsigned char)c * ONES;
+        uint64_t *dw = (uint64_t *)d;
+        while (n >= UNROLL_SIZE) {
+            dw[0] = w;
+            dw[1] = w;
+            dw[2] = w;
+            dw[3] = w;
+            dw += 4;
+            n -= UNROLL_SIZE;
+        }
+        while (n >= WORD_SIZE) {
+            *dw++ = w;
+            n -= WORD_SIZE;
+        }
+        d = (unsigned char *)dw;
+    }
+
+    while (n--) {
+        *d++ = (unsigned char)c;
+    }
+    return dst;
+}
+
 int memcmp(const void *v1, const void *v2, size_t n) {
     const unsigned char *s1, *s2;
     s1 = v1;
     s2 = v2;
+
+    // 按字比较到第一个不相等的字，再交给下面的逐字节比较确定结果
+    if ((((uintptr_t)s1 ^ (uintptr_t)s2) & WORD_MASK) == 0) {
+        while (n > 0 && !IS_ALIGNED(s1)) {
+            if (*s1 != *s2)
+                return *s1 - *s2;
+            s1++, s2++, n--;
+        }
+        const uint64_t *w1 = (const uint64_t *)s1;
+        const uint64_t *w2 = (const uint64_t *)s2;
+        while (n >= UNROLL_SIZE && w1[0] == w2[0] && w1[1] == w2[1] &&
+               w1[2] == w2[2] && w1[3] == w2[3]) {
+            w1 += 4, w2 += 4, n -= UNROLL_SIZE;
+        }
+        while (n >= WORD_SIZE && *w1 == *w2) {
+            w1++, w2++, n -= WORD_SIZE;
+        }
+        s1 = (const unsigned char *)w1;
+        s2 = (const unsigned char *)w2;
+    }
+
     while (n-- > 0) {
         if (*s1 != *s2)
             return *s1 - *s2;
@@ -14,6 +134,16 @@ int memcmp(const void *v1, const void *v2, size_t n) {
 
 size_t strlen(const char *s) {
     const char *p = s;
+    while (!IS_ALIGNED(p)) {
+        if (!*p)
+            return p - s;
+        p++;
+    }
+    // 对齐的 8 字节读取不会跨页，因此越过结尾的读取是安全的
+    const uint64_t *w = (const uint64_t *)p;
+    while (!HAS_ZERO(*w))
+        w++;
+    p = (const char *)w;
     while (*p)
         p++;
     return p - s;
@@ -21,6 +151,18 @@ size_t strlen(const char *s) {
 
 char *strcpy(char *dst, const char *src) {
     char *os = dst;
+    if ((((uintptr_t)dst ^ (uintptr_t)src) & WORD_MASK) == 0) {
+        while (!IS_ALIGNED(src)) {
+            if ((*dst++ = *src++) == 0)
+                return os;
+        }
+        uint64_t *dw = (uint64_t *)dst;
+        const uint64_t *sw = (const uint64_t *)src;
+        while (!HAS_ZERO(*sw))
+            *dw++ = *sw++;
+        dst = (char *)dw;
+        src = (const char *)sw;
+    }
     while ((*dst++ = *src++) != 0)
         ;
     return os;
@@ -28,9 +170,25 @@ char *strcpy(char *dst, const char *src) {
 
 char *strncpy(char *dst, const char *src, size_t n) {
     char *os = dst;
-    while (n-- > 0 && (*dst++ = *src++) != 0)
-        ;
-    while (n-- > 0)
-        *dst++ = 0;
+    while (n > 0 && (*dst++ = *src++) != 0)
+        n--;
+    if (n > 0)
+        memset(dst, 0, n - 1);
     return os;
-}
\ No newline at end of file
+}
+
+int strcmp(const char *a, const char *b) {
+    while (*a && *b) {
+        if (*a < *b)
+            return -1;
+        if (*a > *b)
+            return 1;
+        a++;
+        b++;
+    }
+    if (*a && !*b)
+        return 1;
+    if (*b && !*a)
+        return -1;
+    return 0;
+}
@@ -1,4 +1,7 @@
 #include "syscall.h"
+#include "console.h"
+#include "dtb.h"
+#include "fpu.h"
 #include "fs.h"
 #include "list.h"
 #include "riscv.h"
@@ -9,40 +12,26 @@
 #include "slub.h"
 #include "mm.h"
 #include "vm.h"
+#include "mmap.h"
 
-extern uint64_t text_start;
-extern uint64_t rodata_start;
-extern uint64_t data_start;
-extern uint64_t user_program_start;
-extern void trap_s_bottom(void);
+extern void ret_from_fork(void);
 
-int strcmp(const char *a, const char *b) {
-  while (*a && *b) {
-    if (*a < *b)
-      return -1;
-    if (*a > *b)
-      return 1;
-    a++;
-    b++;
-  }
-  if (*a && !*b)
-    return 1;
-  if (*b && !*a)
-    return -1;
-  return 0;
-}
+// 用户程序在 users.S 中按 4K 对齐依次排列，每个程序的起始地址由符号给出
+extern char user_hello_start[], user_read_start[], user_test_start[],
+    user_fssh_start[], user_forkbomb_start[];
 
 uint64_t get_program_address(const char * name) {
-    uint64_t offset = 0;
-    if (strcmp(name, "hello") == 0) offset = PAGE_SIZE * 2;
-    else if (strcmp(name, "read") == 0) offset = PAGE_SIZE * 4;
-    else if (strcmp(name, "test") == 0) offset = PAGE_SIZE * 6;
-    else if (strcmp(name, "fssh") == 0) offset = PAGE_SIZE * 7;
+    char *start;
+    if (strcmp(name, "hello") == 0) start = user_hello_start;
+    else if (strcmp(name, "read") == 0) start = user_read_start;
+    else if (strcmp(name, "test") == 0) start = user_test_start;
+    else if (strcmp(name, "fssh") == 0) start = user_fssh_start;
+    else if (strcmp(name, "forkbomb") == 0) start = user_forkbomb_start;
     else {
         printf("Unknown user program %s\n", name);
         while (1);
     }
-    return PHYSICAL_ADDR((uint64_t)(&user_program_start) + offset);
+    return PHYSICAL_ADDR((uint64_t)start);
 }
 
 struct ret_info syscall(uint64_t syscall_num, uint64_t arg0, uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t sp) {
@@ -57,7 +46,8 @@ struct ret_info syscall(uint64_t syscall_num, uint64_t arg0, uint64_t arg1, uint
         break;
     }
     case SYS_READ: {
-        ret.a0 = getchar();
+        // 没有输入时睡眠，读到一个字符才返回
+        ret.a0 = console_getchar();
         sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
@@ -75,68 +65,69 @@ struct ret_info syscall(uint64_t syscall_num, uint64_t arg0, uint64_t arg1, uint
         // 6. copy kernel stack (only need trap_s' stack)
         // 7. set new process a0 = 0, and ra = trap_s_bottom, sp = register number * 8
 
-        int i = 0;
-        for (i = 0; i < NR_TASKS; i++) {
-            if (!task[i] || task[i]->counter == 0)
-                break;
+        // 父进程寄存器中的浮点状态先写回 current->fp，子进程复制它
+        fp_flush();
+
+        // 内核栈所在的页面或 pid 用完时 fork 失败，返回 -1
+        uint64_t page = alloc_page();
+        if (page == 0) {
+            sp_ptr[4] = -1;
+            sp_ptr[16] += 4;
+            break;
+        }
+        struct task_struct *p = (struct task_struct*)(VIRTUAL_ADDR(page));
+        spin_lock(&tasklist_lock);
+        if (alloc_pid(p) < 0) {
+            spin_unlock(&tasklist_lock);
+            free_pages(page);
+            sp_ptr[4] = -1;
+            sp_ptr[16] += 4;
+            break;
         }
-        if (!task[i])
-            task[i] = (struct task_struct*)(VIRTUAL_ADDR(alloc_page()));
-        task[i]->state = TASK_RUNNING;
-        task[i]->counter = 1000;
-        task[i]->priority = 999;
-        task[i]->blocked = 0;
-        task[i]->pid = i;
+        p->state = TASK_RUNNING;
+        p->priority = DEFAULT_PRIO;
+        p->counter = task_timeslice(p);
+        p->blocked = 0;
+        p->cpu = select_task_rq();
+        p->on_cpu = 0;
+        p->last_ran = 0;
+        p->exit_code = 0;
+        p->usage = 2;
+        p->fp = current->fp;
+        p->fp_cpu = -1;
+        p->parent = current;
+        INIT_LIST_HEAD(&p->run_list);
+        INIT_LIST_HEAD(&p->children);
+        list_add_tail(&p->sibling, &current->children);
+        init_waitqueue_head(&p->wait_chldexit);
+        spin_unlock(&tasklist_lock);
 
-        uint64_t root_page_table = alloc_page();
-        task[i]->mm.user_program_start = current->mm.user_program_start;
-        task[i]->satp = root_page_table >> 12 | 0x8000000000000000 | (((uint64_t) (task[i]->pid))  << 44);
-        create_mapping((uint64_t*)root_page_table, 0x1000000, task[i]->mm.user_program_start, PAGE_SIZE * 2, PTE_V | PTE_R | PTE_X | PTE_U | PTE_W);
-        // 调用 create_mapping 函数将虚拟地址 0xffffffc000000000 开始的 16 MB 空间映射到起始物理地址为 0x80000000 的 16MB 空间
-        create_mapping((uint64_t*)root_page_table, 0xffffffc000000000, 0x80000000, 16 * 1024 * 1024, PTE_V | PTE_R | PTE_W | PTE_X);
-        // 修改对内核空间不同 section 所在页属性的设置，完成对不同section的保护，其中text段的权限为 r-x, rodata 段为 r--, 其他段为 rw-。
-        create_mapping((uint64_t*)root_page_table, 0xffffffc000000000, 0x80000000, PHYSICAL_ADDR((uint64_t)&rodata_start) - 0x80000000, PTE_V | PTE_R | PTE_X);
-        create_mapping((uint64_t*)root_page_table, (uint64_t)&rodata_start, PHYSICAL_ADDR((uint64_t)&rodata_start), (uint64_t)&data_start - (uint64_t)&rodata_start, PTE_V | PTE_R);
-        create_mapping((uint64_t*)root_page_table, (uint64_t)&data_start, PHYSICAL_ADDR((uint64_t)&data_start), (uint64_t)&_end - (uint64_t)&data_start, PTE_V | PTE_R | PTE_W);
-        // 对内核起始地址 0x80000000 的16MB空间做等值映射（将虚拟地址 0x80000000 开始的 16 MB 空间映射到起始物理地址为 0x80000000 的 16MB 空间）
-        create_mapping((uint64_t*)root_page_table, 0x80000000, 0x80000000, 16 * 1024 * 1024, PTE_V | PTE_R | PTE_W | PTE_X);
-        // 修改对内核空间不同 section 所在页属性的设置，完成对不同section的保护，其中text段的权限为 r-x, rodata 段为 r--, 其他段为 rw-。
-        create_mapping((uint64_t*)root_page_table, 0x80000000, 0x80000000, PHYSICAL_ADDR((uint64_t)&rodata_start) - 0x80000000, PTE_V | PTE_R | PTE_X);
-        create_mapping((uint64_t*)root_page_table, PHYSICAL_ADDR((uint64_t)&rodata_start), PHYSICAL_ADDR((uint64_t)&rodata_start), (uint64_t)&data_start - (uint64_t)&rodata_start, PTE_V | PTE_R);
-        create_mapping((uint64_t*)root_page_table, PHYSICAL_ADDR((uint64_t)&data_start), PHYSICAL_ADDR((uint64_t)&data_start), (uint64_t)&_end - (uint64_t)&data_start, PTE_V | PTE_R | PTE_W);
-        // 将必要的硬件地址（如 0x10000000 为起始地址的 UART ）进行等值映射 ( 可以映射连续 1MB 大小 )，无偏移，3 为映射的读写权限
-        create_mapping((uint64_t*)root_page_table, 0x10000000, 0x10000000, 1 * 1024 * 1024, PTE_V | PTE_R | PTE_W | PTE_X);
-        create_mapping((uint64_t*)root_page_table, 0x0c000000L, 0x0c000000L, 20 * 1024 * 1024, PTE_V | PTE_R | PTE_W | PTE_X);
+        // 新的根页表已经共享了内核空间，只需要建立用户空间的映射
+        uint64_t root_page_table = new_user_pgtbl();
+        p->mm.user_program_start = current->mm.user_program_start;
+        // ASID 在第一次切换到子进程时由 switch_mm 分配
+        p->satp = MAKE_SATP(root_page_table, 0);
+        create_mapping((uint64_t*)root_page_table, 0x1000000, p->mm.user_program_start, PAGE_SIZE * 2, PTE_V | PTE_R | PTE_X | PTE_U | PTE_W);
 
-        uint64_t physical_stack = alloc_page();
-        task[i]->mm.user_stack = physical_stack;
-        task[i]->sscratch = read_csr(sscratch);
-        create_mapping((uint64_t*)root_page_table, 0x1002000, physical_stack, PAGE_SIZE, PTE_V | PTE_R | PTE_W | PTE_U);
-        memcpy((uint64_t *)physical_stack, (uint64_t *)current->mm.user_stack, PAGE_SIZE);
+        // 用户栈和 VMA 中已经驻留的页面都以写时复制的方式与父进程共享，写入时才复制
+        uint64_t parent_page_table = SATP_PGTBL(current->satp);
+        copy_user_range(root_page_table, parent_page_table, 0x1002000, 0x1002000 + PAGE_SIZE);
 
-        task[i]->mm.vm = kmalloc(sizeof(struct vm_area_struct));
-        INIT_LIST_HEAD(&(task[i]->mm.vm->vm_list));
-        struct vm_area_struct* vma;
-        list_for_each_entry(vma, &current->mm.vm->vm_list, vm_list) {
-            struct vm_area_struct * copy = kmalloc(sizeof(struct vm_area_struct));
-            memcpy(copy, vma, sizeof(struct vm_area_struct));
-            list_add(&(copy->vm_list), &task[i]->mm.vm->vm_list);
-            if (vma->mapped) {
-                uint64_t pa = alloc_pages((vma->vm_end - vma->vm_start) / PAGE_SIZE);
-                create_mapping((uint64_t*)root_page_table, vma->vm_start, pa, vma->vm_end - vma->vm_start, vma->vm_flags);
-                uint64_t pte = get_pte((current->satp & ((1ULL << 44) - 1)) << 12, vma->vm_start);
-                memcpy((uint64_t *)pa, (uint64_t *)((pte >> 10) << 12), vma->vm_end - vma->vm_start);
-            }
-        }
+        mm_init(&p->mm);
+        dup_mmap(&p->mm, root_page_table, &current->mm, parent_page_table);
+        // 父进程中的页面已经改为只读，刷新父进程 ASID 中的旧映射
+        flush_tlb_asid(mm_asid(&current->mm));
 
-        sp_ptr[4] = task[i]->pid;
+        sp_ptr[4] = p->pid;
         sp_ptr[16] += 4;
 
-        memcpy((uint64_t*)((uint64_t)task[i] + PAGE_SIZE - 31 * 8), (uint64_t*)((uint64_t)current + PAGE_SIZE - 31 * 8), 31 * 8);
+        // 陷入帧的第 31 项是用户栈指针，子进程和父进程相同
+        memcpy((uint64_t*)((uint64_t)p + PAGE_SIZE - 32 * 8), (uint64_t*)((uint64_t)current + PAGE_SIZE - 32 * 8), 32 * 8);
 
-        *(uint64_t *)((uint64_t)(sp_ptr + 4) - (uint64_t)current + (uint64_t)task[i]) = 0;
-        task[i]->thread.sp = (uint64_t)task[i] + PAGE_SIZE - 31 * 8;
-        task[i]->thread.ra = (uint64_t)&trap_s_bottom;
+        *(uint64_t *)((uint64_t)(sp_ptr + 4) - (uint64_t)current + (uint64_t)p) = 0;
+        p->thread.sp = (uint64_t)p + PAGE_SIZE - 32 * 8;
+        p->thread.ra = (uint64_t)&ret_from_fork;
+        enqueue_task(p);
 
         break;
     }
@@ -147,24 +138,18 @@ struct ret_info syscall(uint64_t syscall_num, uint64_t arg0, uint64_t arg1, uint
         // 3. create mapping for new user program address
         // 4. set sepc = 0x1000000
 
-        uint64_t root_page_table = (current->satp & ((1ULL << 44) - 1)) << 12;
-        struct vm_area_struct* vma;
-        list_for_each_entry(vma, &current->mm.vm->vm_list, vm_list) {
-            if (vma->mapped == 1) {
-                uint64_t pte = get_pte((uint64_t*)root_page_table, vma->vm_start);
-                free_pages((pte >> 10) << 12);
-            }
-            create_mapping((uint64_t*)root_page_table, vma->vm_start, 0, (vma->vm_end - vma->vm_start), 0);
-            list_del(&(vma->vm_list));
-            kfree(vma);
-        }
+        uint64_t root_page_table = SATP_PGTBL(current->satp);
+        exit_mmap(&current->mm, root_page_table);
 
-        write_csr(sscratch, 0x1002000 + PAGE_SIZE);
+        // 返回用户态时 trap_s_bottom 从陷入帧中取出用户栈指针
+        sp_ptr[31] = 0x1002000 + PAGE_SIZE;
+        fp_reset();
 
         current->mm.user_program_start = get_program_address((char *)arg0);
         create_mapping((uint64_t*)root_page_table, 0x1000000, current->mm.user_program_start, PAGE_SIZE * 2, PTE_V | PTE_R | PTE_X | PTE_U | PTE_W);
 
-        asm volatile ("sfence.vma");
+        // 只刷新当前进程的 ASID，内核空间的全局映射不受影响
+        flush_tlb_asid(mm_asid(&current->mm));
         sp_ptr[16] = 0x1000000;
 
         break;
@@ -174,54 +159,99 @@ struct ret_info syscall(uint64_t syscall_num, uint64_t arg0, uint64_t arg1, uint
         // 1. free current process vm_area_struct and it's mapping area
         // 2. free user stack
         // 3. free page table
-        // 4. clear current task, set current task->counter = 0
+        // 4. clear current task, set current task->state = TASK_ZOMBIE
+        //    and wake up the parent waiting in SYS_WAIT
         // 5. call schedule
 
-        uint64_t root_page_table = (current->satp & ((1ULL << 44) - 1)) << 12;
-        struct vm_area_struct* vma;
-        list_for_each_entry(vma, &current->mm.vm->vm_list, vm_list) {
-            if (vma->mapped == 1) {
-                uint64_t pte = get_pte((uint64_t*)root_page_table, vma->vm_start);
-                free_pages((pte >> 10) << 12);
-            }
-            create_mapping((uint64_t*)root_page_table, vma->vm_start, 0, (vma->vm_end - vma->vm_start), 0);
-            list_del(&(vma->vm_list));
-            kfree(vma);
-        }
-        kfree(&(current->mm.vm));
+        uint64_t root_page_table = SATP_PGTBL(current->satp);
+        // 释放的页面和页表可能立刻被其他 hart 重新分配，本 hart 不能再经过它们访问内存：
+        // 先换到内核页表并刷掉本进程 ASID 的 TLB 表项，之后只通过直接映射访问这些页表
+        current->satp = MAKE_SATP(kernel_pgtbl, 0);
+        write_csr(satp, current->satp);
+        flush_tlb_asid(mm_asid(&current->mm));
+
+        exit_mmap(&current->mm, root_page_table);
+        kfree(current->mm.vm);
         current->mm.vm = NULL;
 
-        free_pages(current->mm.user_stack);
-        current->mm.user_stack = 0;
+        unmap_user_range(root_page_table, 0x1002000, 0x1002000 + PAGE_SIZE);
+
+        free_user_pgtbl(root_page_table);
 
-        free_pages(root_page_table);
+        // 父进程退出后没有进程会回收子进程：已经退出的直接释放，仍在运行的在退出时释放
+        spin_lock(&tasklist_lock);
+        struct task_struct *child, *tmp;
+        list_for_each_entry_safe(child, tmp, &current->children, sibling) {
+            list_del_init(&child->sibling);
+            child->parent = NULL;
+            if (child->state == TASK_ZOMBIE) {
+                child->state = TASK_DEAD;
+                put_task_struct(child);
+            }
+        }
 
-        current->counter = 0;
+        current->exit_code = arg0;
+        if (current->parent) {
+            current->state = TASK_ZOMBIE;
+            wake_up(&current->parent->wait_chldexit);
+        } else {
+            current->state = TASK_DEAD;
+            put_task_struct(current);
+        }
+        dequeue_task(current);
+        spin_unlock(&tasklist_lock);
         schedule(0);
         break;
     }
     case SYS_WAIT: {
-        // TODO:
-        // 1. find the process which pid == arg0
-        // 2. if not find
-        //   2.1. sepc += 4, return
-        // 3. if find
-        //   3.1. change current process's priority
-        //   3.2. call schedule to run other process
-        //   3.3. goto 1. check again
-        int exec_finish = 0;
-        while (!exec_finish) {
-            exec_finish = 1;
-            for (int i = 0; i < NR_TASKS; i++) {
-                if (task[i]) {
-                    if (task[i]->pid == arg0 && task[i]->counter > 0) {
-                        current->priority = task[i]->priority + 1;
-                        exec_finish = 0;
-                        schedule(0);
+        // arg0 为要等待的子进程的 pid，-1 表示任意子进程；arg1 非 0 时写入子进程的退出码
+        // 1. find a zombie child in current->children, reap it and return its pid
+        // 2. if there is no such child at all, return -1
+        // 3. otherwise sleep on current->wait_chldexit until a child exits, goto 1.
+        long pid = (long)arg0;
+        int status = 0;
+        ret.a0 = -1;
+        spin_lock(&tasklist_lock);
+        while (1) {
+            struct task_struct *child, *zombie = NULL;
+            bool found = 0;
+            if (pid != -1) {
+                // 指定了 pid 时直接查表，不遍历子进程链表
+                child = find_task_by_pid(pid);
+                if (child && child->parent == current) {
+                    found = 1;
+                    if (child->state == TASK_ZOMBIE)
+                        zombie = child;
+                }
+            } else {
+                list_for_each_entry(child, &current->children, sibling) {
+                    found = 1;
+                    if (child->state == TASK_ZOMBIE) {
+                        zombie = child;
+                        break;
                     }
                 }
             }
+            if (zombie) {
+                status = zombie->exit_code;
+                ret.a0 = zombie->pid;
+                list_del_init(&zombie->sibling);
+                zombie->parent = NULL;
+                zombie->state = TASK_DEAD;
+                put_task_struct(zombie);
+                break;
+            }
+            if (!found)
+                break;
+            sleep_on(&current->wait_chldexit, &tasklist_lock);
         }
+        spin_unlock(&tasklist_lock);
+        // 写用户内存可能处理缺页并分配内存，不在持锁时进行。
+        // 子进程此时已经回收，退出码写不进去时仍然返回 -1
+        if ((long)ret.a0 != -1 && arg1 &&
+            copy_to_user((void *)arg1, &status, sizeof(status)) != 0)
+            ret.a0 = -1;
+        sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
     }
@@ -239,76 +269,89 @@ struct ret_info syscall(uint64_t syscall_num, uint64_t arg0, uint64_t arg1, uint
         sp_ptr[16] += 4;
         break;
     }
+    case SYS_CPUSTAT: {
+        // arg0 为用户的 struct cpu_stat 数组，arg1 为数组长度，返回填入的个数
+        struct cpu_stat stat[NR_CPUS];
+        int n = get_cpu_stat(stat, (int)arg1);
+        ret.a0 = n;
+        if (copy_to_user((void *)arg0, stat, n * sizeof(struct cpu_stat)) != 0)
+            ret.a0 = -1;
+        sp_ptr[4] = ret.a0;
+        sp_ptr[16] += 4;
+        break;
+    }
+    case SYS_TIMEBASE: {
+        ret.a0 = boot_info.timebase_freq;
+        sp_ptr[4] = ret.a0;
+        sp_ptr[16] += 4;
+        break;
+    }
     case SYS_MMAP: {
-        struct vm_area_struct* vma = (struct vm_area_struct*)kmalloc(sizeof(struct vm_area_struct));
-        if (vma == NULL) {
+        // 只建立 VMA，物理页面在第一次访问时逐页分配
+        // VMA 可能与相邻的 VMA 合并，返回值是用户请求的起始地址
+        // 用户只能指定 R/W/X 权限，PTE_G、PTE_COW 等其他位由内核管理
+        uint64_t prot = (arg2 & (PTE_R | PTE_W | PTE_X)) | PTE_V | PTE_U;
+        if (do_mmap(&current->mm, arg0, arg1, prot) == NULL) {
             ret.a0 = -1;
-            break;
+        } else {
+            ret.a0 = arg0;
         }
-        vma->vm_start = arg0;
-        vma->vm_end = arg0 + arg1;
-        vma->vm_flags = arg2;
-        vma->mapped = 0;
-        list_add(&(vma->vm_list), &(current->mm.vm->vm_list));
-
-        ret.a0 = vma->vm_start;
+        sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
     }
     case SYS_MUNMAP: {
-        ret.a0 = -1;
-        struct vm_area_struct* vma;
-        list_for_each_entry(vma, &current->mm.vm->vm_list, vm_list) {
-            if (vma->vm_start == arg0 && vma->vm_end == arg0 + arg1) {
-                if (vma->mapped == 1) {
-                    uint64_t pte = get_pte((current->satp & ((1ULL << 44) - 1)) << 12, vma->vm_start);
-                    free_pages((pte >> 10) << 12);
-                }
-                create_mapping((current->satp & ((1ULL << 44) - 1)) << 12, vma->vm_start, 0, (vma->vm_end - vma->vm_start), 0);
-                list_del(&(vma->vm_list));
-                kfree(vma);
-
-                ret.a0 = 0;
-                break;
-            }
-        }
-        // flash the TLB
-        asm volatile ("sfence.vma");
+        ret.a0 = do_munmap(&current->mm, SATP_PGTBL(current->satp), arg0, arg1);
+        // flush the TLB entries of the unmapped range
+        flush_tlb_range(mm_asid(&current->mm), arg0, arg0 + arg1);
+        sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
     }
     case SFS_OPEN: {
+        spin_lock(&sfs_lock);
         ret.a0 = sfs_open((const char *)arg0, arg1);
+        spin_unlock(&sfs_lock);
         sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
     }
     case SFS_READ: {
+        spin_lock(&sfs_lock);
         ret.a0 = sfs_read(arg0, (const char *)arg1, arg2);
+        spin_unlock(&sfs_lock);
         sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
     }
     case SFS_WRITE: {
+        spin_lock(&sfs_lock);
         ret.a0 = sfs_write(arg0, (const char *)arg1, arg2);
+        spin_unlock(&sfs_lock);
         sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
     }
     case SFS_SEEK: {
+        spin_lock(&sfs_lock);
         ret.a0 = sfs_seek(arg0, arg1, arg2);
+        spin_unlock(&sfs_lock);
         sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
     }
     case SFS_GET_FILES: {
+        spin_lock(&sfs_lock);
         ret.a0 = sfs_get_files((const char *)arg0, (char **)arg1);
+        spin_unlock(&sfs_lock);
         sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
     }
     case SFS_CLOSE: {
+        spin_lock(&sfs_lock);
         ret.a0 = sfs_close(arg0);
+        spin_unlock(&sfs_lock);
         sp_ptr[4] = ret.a0;
         sp_ptr[16] += 4;
         break;
@@ -2,15 +2,22 @@
 
 #include "vm.h"
 #include "mm.h"
+#include "mmap.h"
+#include "sched.h"
+#include "slub.h"
 #include "stdio.h"
+#include "string.h"
 
-struct task_struct *task[NR_TASKS];
-struct task_struct *current;
+spinlock_t tasklist_lock = SPINLOCK_INIT;
+
+// pid 到进程的两级表：第二级每页 512 项，第一次用到时分配，之后不再释放
+#define PIDS_PER_PAGE (PAGE_SIZE / sizeof(struct task_struct *))
+
+static struct task_struct **pid_table[PID_MAX / PIDS_PER_PAGE];
+// 第 i 位表示 pid i 已经被使用
+static uint64_t pidmap[PID_MAX / 64];
+static long last_pid;
 
-extern uint64_t text_start;
-extern uint64_t rodata_start;
-extern uint64_t data_start;
-extern uint64_t _end;
 extern uint64_t user_program_start;
 
 // get pid of current process
@@ -18,61 +25,108 @@ int getpid() {
   return current->pid;
 }
 
+static int attach_pid(struct task_struct *p, long pid) {
+  struct task_struct ***slot = &pid_table[pid / PIDS_PER_PAGE];
+  if (*slot == NULL) {
+    *slot = kzalloc(PAGE_SIZE);
+    if (*slot == NULL) {
+      return -1;
+    }
+  }
+  (*slot)[pid % PIDS_PER_PAGE] = p;
+  pidmap[pid / 64] |= 1UL << (pid % 64);
+  p->pid = pid;
+  return 0;
+}
+
+// 从 start 开始按 64 位一组查找未使用的 pid，到 PID_MAX 后回到 1
+static long find_free_pid(long start) {
+  long pid = start;
+  for (long scanned = 0; scanned < PID_MAX;) {
+    if (pid >= PID_MAX) {
+      pid = 1;
+    }
+    uint64_t free = ~pidmap[pid / 64] >> (pid % 64);
+    if (free) {
+      return pid + __builtin_ctzl(free);
+    }
+    scanned += 64 - pid % 64;
+    pid += 64 - pid % 64;
+  }
+  return -1;
+}
+
+long alloc_pid(struct task_struct *p) {
+  long pid = find_free_pid(last_pid + 1);
+  if (pid < 0 || attach_pid(p, pid) < 0) {
+    return -1;
+  }
+  last_pid = pid;
+  return pid;
+}
+
+void free_pid(long pid) {
+  pid_table[pid / PIDS_PER_PAGE][pid % PIDS_PER_PAGE] = NULL;
+  pidmap[pid / 64] &= ~(1UL << (pid % 64));
+}
+
+struct task_struct *find_task_by_pid(long pid) {
+  if (pid < 0 || pid >= PID_MAX || pid_table[pid / PIDS_PER_PAGE] == NULL) {
+    return NULL;
+  }
+  return pid_table[pid / PIDS_PER_PAGE][pid % PIDS_PER_PAGE];
+}
+
+void put_task_struct(struct task_struct *p) {
+  if (--p->usage == 0) {
+    free_pid(p->pid);
+    free_pages(PHYSICAL_ADDR(p));
+  }
+}
+
 // initialize tasks, set member variables
 void task_init(void) {
   // only init the first process
   struct task_struct* new_task = (struct task_struct*)(VIRTUAL_ADDR(alloc_page()));
   new_task->state = TASK_RUNNING;
-  new_task->counter = 1000;
-  new_task->priority = 1000;
+  new_task->priority = INIT_TASK_PRIO;
+  new_task->counter = task_timeslice(new_task);
   new_task->blocked = 0;
-  new_task->pid = 0;
-  task[0] = new_task;
-  task[0]->thread.sp = (uint64_t)task[0] + PAGE_SIZE; // 内核栈的栈底
-  task[0]->thread.ra = (uint64_t)__init_sepc;
+  new_task->cpu = smp_processor_id();
+  new_task->on_cpu = 0;
+  new_task->last_ran = 0;
+  new_task->parent = NULL;
+  new_task->usage = 2;
+  memset(&new_task->fp, 0, sizeof(new_task->fp));
+  new_task->fp_cpu = -1;
+  INIT_LIST_HEAD(&new_task->children);
+  INIT_LIST_HEAD(&new_task->sibling);
+  init_waitqueue_head(&new_task->wait_chldexit);
+  spin_lock(&tasklist_lock);
+  attach_pid(new_task, 0);
+  spin_unlock(&tasklist_lock);
+  new_task->thread.sp = (uint64_t)new_task + PAGE_SIZE; // 内核栈的栈底
+  new_task->thread.ra = (uint64_t)__init_sepc;
 
-  task[0]->mm.vm = kmalloc(sizeof(struct vm_area_struct));
-  INIT_LIST_HEAD(&(task[0]->mm.vm->vm_list));
+  mm_init(&new_task->mm);
     
   uint64_t task_addr = PHYSICAL_ADDR((uint64_t)&user_program_start);
 
   // DONE: 完成用户栈的分配，并创建页表项，将用户栈映射到实际的物理地址
-  // 1. 为用户栈分配物理页面，使用alloc_page函数
-  // 2. 为用户进程分配根页表，使用alloc_page函数
+  // 1. 为用户栈分配物理页面，使用alloc_user_pages函数，页面的引用计数为 1
+  // 2. 为用户进程分配根页表，使用new_user_pgtbl函数，其中已经包含了内核空间的映射
   // 3. 将task[i]->sscratch指定为虚拟空间下的栈地址，即0x1001000 + PAGE_SIZE（注意栈是从高地址到低地址使用的）
   // 4. 正确设置task[i]->satp，注意设置ASID
   // 5. 将用户栈映射到实际的物理地址，使用create_mapping函数
   // 6. 将用户程序映射到虚拟地址空间，使用create_mapping函数
-  // 7. 将将虚拟地址 0xffffffc000000000 开始的 16 MB 空间映射到起始物理地址为 0x80000000 的 16MB 地址空间，注意此时 &rodata_start、... 得到的是虚拟地址还是物理地址？我们需要的是什么地址？
-  // 8. 对内核起始地址 0x80000000 的16MB空间做等值映射（将虚拟地址 0x80000000 开始的 16 MB 空间映射到起始物理地址为 0x80000000 的 16MB 空间），PTE_V | PTE_R | PTE_W | PTE_X 为映射的读写权限。
-  // 9. 修改对内核空间不同 section 所在页属性的设置，完成对不同section的保护，其中text段的权限为 r-x, rodata 段为 r--, 其他段为 rw-，注意上述两个映射都需要做保护。
-  // 10. 将必要的硬件地址（如 0x10000000 为起始地址的 UART ）进行等值映射 ( 可以映射连续 1MB 大小 )，无偏移，PTE_V | PTE_R 为映射的读写权限
-  uint64_t physical_stack = alloc_page();
-  uint64_t root_page_table = alloc_page();
-  task[0]->mm.user_stack = physical_stack;
-  task[0]->mm.user_program_start = task_addr;
-  task[0]->sscratch = (uint64_t)0x1002000 + PAGE_SIZE;
-  task[0]->satp = root_page_table >> 12 | 0x8000000000000000 | (((uint64_t) (new_task->pid))  << 44);
+  uint64_t physical_stack = alloc_user_pages(1, GFP_ZERO);
+  uint64_t root_page_table = new_user_pgtbl();
+  new_task->mm.user_program_start = task_addr;
+  new_task->sscratch = (uint64_t)0x1002000 + PAGE_SIZE;
+  new_task->satp = MAKE_SATP(root_page_table, 0); // ASID 由 switch_mm 分配
   create_mapping((uint64_t*)root_page_table, 0x1002000, physical_stack, PAGE_SIZE, PTE_V | PTE_R | PTE_W | PTE_U);
   create_mapping((uint64_t*)root_page_table, 0x1000000, task_addr, PAGE_SIZE * 2, PTE_V | PTE_R | PTE_X | PTE_U | PTE_W);
 
-  // 调用 create_mapping 函数将虚拟地址 0xffffffc000000000 开始的 16 MB 空间映射到起始物理地址为 0x80000000 的 16MB 空间
-  create_mapping((uint64_t*)root_page_table, 0xffffffc000000000, 0x80000000, 16 * 1024 * 1024, PTE_V | PTE_R | PTE_W | PTE_X);
-  // 修改对内核空间不同 section 所在页属性的设置，完成对不同section的保护，其中text段的权限为 r-x, rodata 段为 r--, 其他段为 rw-。
-  create_mapping((uint64_t*)root_page_table, 0xffffffc000000000, 0x80000000, PHYSICAL_ADDR((uint64_t)&rodata_start) - 0x80000000, PTE_V | PTE_R | PTE_X);
-  create_mapping((uint64_t*)root_page_table, (uint64_t)&rodata_start, PHYSICAL_ADDR((uint64_t)&rodata_start), (uint64_t)&data_start - (uint64_t)&rodata_start, PTE_V | PTE_R);
-  create_mapping((uint64_t*)root_page_table, (uint64_t)&data_start, PHYSICAL_ADDR((uint64_t)&data_start), (uint64_t)&_end - (uint64_t)&data_start, PTE_V | PTE_R | PTE_W);
-  
-  // 对内核起始地址 0x80000000 的16MB空间做等值映射（将虚拟地址 0x80000000 开始的 16 MB 空间映射到起始物理地址为 0x80000000 的 16MB 空间）
-  create_mapping((uint64_t*)root_page_table, 0x80000000, 0x80000000, 16 * 1024 * 1024, PTE_V | PTE_R | PTE_W | PTE_X);
-  // 修改对内核空间不同 section 所在页属性的设置，完成对不同section的保护，其中text段的权限为 r-x, rodata 段为 r--, 其他段为 rw-。
-  create_mapping((uint64_t*)root_page_table, 0x80000000, 0x80000000, PHYSICAL_ADDR((uint64_t)&rodata_start) - 0x80000000, PTE_V | PTE_R | PTE_X);
-  create_mapping((uint64_t*)root_page_table, PHYSICAL_ADDR((uint64_t)&rodata_start), PHYSICAL_ADDR((uint64_t)&rodata_start), (uint64_t)&data_start - (uint64_t)&rodata_start, PTE_V | PTE_R);
-  create_mapping((uint64_t*)root_page_table, PHYSICAL_ADDR((uint64_t)&data_start), PHYSICAL_ADDR((uint64_t)&data_start), (uint64_t)&_end - (uint64_t)&data_start, PTE_V | PTE_R | PTE_W);
-  
-  // 将必要的硬件地址（如 0x10000000 为起始地址的 UART ）进行等值映射 ( 可以映射连续 1MB 大小 )，无偏移，3 为映射的读写权限
-  create_mapping((uint64_t*)root_page_table, 0x10000000, 0x10000000, 1 * 1024 * 1024, PTE_V | PTE_R | PTE_W | PTE_X);
-  create_mapping((uint64_t*)root_page_table, 0x0c000000L, 0x0c000000L, 20 * 1024 * 1024, PTE_V | PTE_R | PTE_W | PTE_X);
-
-  printf("[PID = %d] Process Create Successfully!\n", task[0]->pid);
+  enqueue_task(new_task);
+  printf("[PID = %d] Process Create Successfully!\n", new_task->pid);
 }
\ No newline at end of file
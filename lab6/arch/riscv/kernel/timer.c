@@ -0,0 +1,122 @@
+#include "timer.h"
+
+#include "dtb.h"
+#include "riscv.h"
+#include "sbi.h"
+#include "sched.h"
+#include "smp.h"
+
+uint64_t tick_hz;
+uint64_t tick_cycles;
+
+// 每个 hart 的 mtimecmp 是独立的，tick 和定时器也按 hart 分开管理，
+// 只在本 hart 上访问，内核中没有中断嵌套，因此不需要加锁
+struct timer_base {
+  // 下一个 tick 的到期时间，不需要 tick 时为 TIMER_OFF
+  uint64_t tick_next;
+  // 当前已经交给 M 模式的到期时间
+  uint64_t next_event;
+  // 按到期时间排序的定时器
+  struct list_head timers;
+};
+
+static struct timer_base timer_bases[NR_CPUS];
+
+#define this_timer_base() (&timer_bases[smp_processor_id()])
+
+static void program_event(struct timer_base *base, uint64_t deadline,
+                          bool force) {
+  if (deadline != base->next_event || force) {
+    base->next_event = deadline;
+    sbi_set_timer(deadline);
+  }
+}
+
+static void __timer_reprogram(bool force) {
+  if (tick_cycles == 0) {
+    return;
+  }
+  struct timer_base *base = this_timer_base();
+  // 只有一个可运行的进程时时间片到期也不会切换，不需要 tick
+  if (!sched_need_tick()) {
+    base->tick_next = TIMER_OFF;
+  } else if (base->tick_next == TIMER_OFF) {
+    base->tick_next = rdtime() + tick_cycles;
+  }
+
+  uint64_t deadline = base->tick_next;
+  if (!list_empty(&base->timers)) {
+    struct timer_list *first =
+        list_first_entry(&base->timers, struct timer_list, entry);
+    if (first->expires < deadline) {
+      deadline = first->expires;
+    }
+  }
+  program_event(base, deadline, force);
+}
+
+void timer_reprogram(void) {
+  __timer_reprogram(0);
+}
+
+void timer_init(void) {
+  for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+    timer_bases[cpu].tick_next = TIMER_OFF;
+    timer_bases[cpu].next_event = TIMER_OFF;
+    INIT_LIST_HEAD(&timer_bases[cpu].timers);
+  }
+  tick_hz = boot_info.tick_hz;
+  tick_cycles = boot_info.timebase_freq / tick_hz;
+  timer_init_cpu();
+}
+
+void timer_init_cpu(void) {
+  __timer_reprogram(1);
+}
+
+void add_timer(struct timer_list *timer) {
+  struct timer_base *base = this_timer_base();
+  struct timer_list *t;
+  list_for_each_entry(t, &base->timers, entry) {
+    if (t->expires > timer->expires) {
+      break;
+    }
+  }
+  list_add_tail(&timer->entry, &t->entry);
+  timer_reprogram();
+}
+
+void del_timer(struct timer_list *timer) {
+  list_del_init(&timer->entry);
+  timer_reprogram();
+}
+
+void timer_interrupt(void) {
+  struct timer_base *base = this_timer_base();
+  uint64_t now = rdtime();
+
+  while (!list_empty(&base->timers)) {
+    struct timer_list *t =
+        list_first_entry(&base->timers, struct timer_list, entry);
+    if (t->expires > now) {
+      break;
+    }
+    list_del_init(&t->entry);
+    t->function(t);
+  }
+
+  bool tick = base->tick_next != TIMER_OFF && now >= base->tick_next;
+  if (tick) {
+    // 按固定的间隔推进，不受中断处理延迟的影响；错过多个 tick 时从现在重新开始
+    base->tick_next += tick_cycles;
+    if (base->tick_next <= now) {
+      base->tick_next = now + tick_cycles;
+    }
+  }
+  // M 模式在中断到来时关闭了时钟中断并置位 STIP，必须 ecall 一次才能清除
+  __timer_reprogram(1);
+
+  if (tick) {
+    do_timer();
+  }
+}
@@ -1,9 +1,13 @@
 #include "defs.h"
+#include "fpu.h"
 #include "mm.h"
+#include "mmap.h"
 #include "sched.h"
+#include "smp.h"
 #include "stdio.h"
 #include "syscall.h"
 #include "task_manager.h"
+#include "timer.h"
 #include "virtio.h"
 #include "vm.h"
 
@@ -15,13 +19,30 @@ void m_ext_handler() {
   }
 }
 
+// Traps taken in S mode. The kernel runs with interrupts disabled and never
+// uses floating point, so the only expected case is a page fault on user
+// memory touched by a syscall; anything else is a kernel bug.
+void handler_s_kernel(uint64_t cause, uint64_t epc, uint64_t stval) {
+  if ((cause == CAUSE_LOAD_PAGE_FAULT || cause == CAUSE_STORE_PAGE_FAULT) &&
+      stval < USER_MMAP_END && handle_mm_fault(stval, cause) == 0) {
+    return;
+  }
+  printf("Kernel trap! scause = 0x%016lx, epc = 0x%016lx, stval = 0x%016lx\n",
+         cause, epc, stval);
+  while (1)
+    ;
+}
+
 void handler_s(uint64_t cause, uint64_t epc, uint64_t sp) {
   // interrupt
   if (cause >> 63 == 1) {
     // supervisor timer interrupt
     if (cause == 0x8000000000000005) {
-      asm volatile("ecall");
-      do_timer();
+      timer_interrupt();
+    }
+    // supervisor software interrupt, forwarded by M mode for an IPI
+    else if (cause == 0x8000000000000001) {
+      smp_ipi_interrupt();
     }
   }
   // exception
@@ -35,46 +56,15 @@ void handler_s(uint64_t cause, uint64_t epc, uint64_t sp) {
 
       // printf("Page fault! epc = 0x%016lx, stval = 0x%016lx\n", epc, stval);
 
-      // 2. check whether the faulting address is in the range of a vm area
-      // 3. check the permission of the vm area. The vma must be PTE_X/R/W
-      // according to the faulting cause, and also be PTE_V, PTE_U
-      // 4. if the faulting address is valid, allocate physical pages, map it to
-      // the vm area, mark the vma mapped(vma->mapped = 1), and return
-      // 5. otherwise, print error message and add 4 to the sepc (DONE)
+      // 2. copy the page if it is a copy-on-write page
+      // 3. otherwise find the vm area and check its permission, then allocate
+      // and map the faulting page (and its fault-around neighbours)
+      // 4. if the fault cannot be handled, add 4 to the sepc (DONE)
 
       uint64_t *sp_ptr = (uint64_t *)(sp);
-
-      struct vm_area_struct *vma;
-      list_for_each_entry(vma, &current->mm.vm->vm_list, vm_list) {
-        if (stval >= vma->vm_start && stval < vma->vm_end) {
-          if ((vma->vm_flags & PTE_V) && (vma->vm_flags & PTE_U) &&
-              (((vma->vm_flags & PTE_X) && cause == 0xc) ||
-               ((vma->vm_flags & PTE_R) && cause == 0xd) ||
-               ((vma->vm_flags & PTE_R) && (vma->vm_flags & PTE_W) &&
-                cause == 0xf))) {
-
-            uint64_t pa =
-                alloc_pages((vma->vm_end - vma->vm_start) / PAGE_SIZE);
-            if (pa == 0) {
-              printf("alloc_pages failed!\n");
-              sp_ptr[16] += 4;
-              return;
-            }
-            create_mapping((current->satp & ((1ULL << 44) - 1)) << 12,
-                           vma->vm_start, pa, (vma->vm_end - vma->vm_start),
-                           vma->vm_flags);
-            vma->mapped = 1;
-            return;
-          } else {
-            printf("Invalid permission! scause: %llx flags: %llx \n", cause,
-                   vma->vm_flags);
-            sp_ptr[16] += 4;
-            return;
-          }
-        }
+      if (handle_mm_fault(stval, cause) != 0) {
+        sp_ptr[16] += 4;
       }
-      printf("Unhandled page fault! addr = 0x%016lx\n", stval);
-      sp_ptr[16] += 4;
       return;
     }
     // syscall from user mode
@@ -95,6 +85,15 @@ void handler_s(uint64_t cause, uint64_t epc, uint64_t sp) {
                arg3 = sp_ptr[7], arg4 = sp_ptr[8], arg5 = sp_ptr[9];
 
       syscall(syscall_num, arg0, arg1, arg2, arg3, arg4, arg5, sp);
+    }
+    // illegal instruction: the first floating-point instruction of a task
+    // after a switch, with sstatus.FS still off
+    else if (cause == 0x2) {
+      if (!fp_trap()) {
+        printf("Illegal instruction! epc = 0x%016lx\n", epc);
+        while (1)
+          ;
+      }
     } else {
       printf("Unknown exception! epc = 0x%016lx\n", epc);
       while (1)
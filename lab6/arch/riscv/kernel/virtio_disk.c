@@ -10,7 +10,7 @@
 #include "sched.h"
 #include "virtio.h"
 #include "vm.h"
-#include <string.h>
+#include "string.h"
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32_t *)(VIRTIO0 + (r)))
 
@@ -310,27 +310,24 @@ virtio_disk_intr()
 }
 
 
-static inline uint64_t r_tp() {
+static inline uint64_t r_mhartid() {
   uint64_t x;
-  asm volatile("mv %0, tp" : "=r"(x));
+  asm volatile("csrr %0, mhartid" : "=r"(x));
   return x;
 }
 
-static int cpuid() {
-  int id = r_tp();
-  return id;
-}
-
+// tp 指向当前进程，不再是 hart 编号。设备中断只打开调用 plic_init 的 hart 的 S 模式上下文
 void plic_init() {
   *(uint32_t *)(PLIC + UART0_IRQ * 4) = 1;
   *(uint32_t *)(PLIC + VIRTIO0_IRQ * 4) = 1;
-  int hart = cpuid();
+  int hart = smp_processor_id();
   *(uint32_t *)PLIC_SENABLE(hart) = (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
   *(uint32_t *)PLIC_SPRIORITY(hart) = 0;
 }
 
+// 在 M 模式的外部中断处理中调用，认领被中断的 hart 的上下文
 int plic_claim(void) {
-  int hart = 0;
+  int hart = r_mhartid();
   int irq = *(uint32_t *)PLIC_SCLAIM(hart);
   return irq;
 }
\ No newline at end of file
@@ -2,6 +2,11 @@
 #include "mm.h"
 #include "sched.h"
 #include "stdio.h"
+#include "dtb.h"
+#include "mmap.h"
+#include "riscv.h"
+#include "smp.h"
+#include "spinlock.h"
 
 extern uint64_t text_start;
 extern uint64_t rodata_start;
@@ -9,6 +14,30 @@ extern uint64_t data_start;
 extern uint64_t _end;
 extern uint64_t user_program_start;
 
+int vm_superpages = 1;
+uint64_t *kernel_pgtbl;
+
+uint64_t asid_bits;
+// 当前的代数，以 1 << asid_bits 为单位递增
+static uint64_t asid_generation;
+// 当前代中下一个可分配的 ASID，ASID 0 留给内核页表
+static uint64_t next_asid;
+// 保护以上两项以及各进程的 context_id
+static spinlock_t asid_lock = SPINLOCK_INIT;
+// 进入新一代后每个 hart 在下一次切换地址空间时刷新一次整个 TLB
+static bool tlb_flush_pending[NR_CPUS];
+
+// 把 level 级的大页叶子项拆成下一级页表中的 512 个叶子项，映射和权限保持不变
+static void split_leaf(uint64_t *pte, int level) {
+  uint64_t *table = (uint64_t *)alloc_page();
+  uint64_t pa = PTE_TO_PA(*pte);
+  uint64_t flags = *pte & PTE_FLAGS;
+  for (int i = 0; i < 512; i++) {
+    table[i] = PA_TO_PTE(pa + i * LEVEL_SIZE(level - 1)) | flags;
+  }
+  *pte = PA_TO_PTE((uint64_t)table) | PTE_V;
+}
+
 void create_mapping(uint64_t *pgtbl, uint64_t va, uint64_t pa, uint64_t sz,
                     int perm) {
   // pgtbl 为根页表的基地址
@@ -28,125 +57,337 @@ void create_mapping(uint64_t *pgtbl, uint64_t va, uint64_t pa, uint64_t sz,
   // 7. 设置二级页表项的内容
   // 8. 设置三级页表项的内容
 
+  // 9. 不带 PTE_U 的映射在 va、pa 和剩余大小都对齐时直接在一级、二级页表中
+  //    填写 1GB、2MB 的大页叶子项；若要修改的范围落在已有大页的内部，
+  //    先把大页拆成下一级的 512 个叶子项，保证各 section 的权限在边界处仍然生效
+
   // DONE: 请完成你的代码
-  int page_num = (sz - 1) / PAGE_SIZE + 1;
-
-  for (int i = 0; i < page_num; ++i) {
-
-    uint64_t va_i = va + i * PAGE_SIZE;
-    uint64_t pa_i = pa + i * PAGE_SIZE;
-
-    // 通过 va 得到一级页表项的索引
-    uint64_t first_index = (va_i >> 30) & 0x1ff;
-    // 通过 va 得到二级页表项的索引
-    uint64_t second_index = (va_i >> 21) & 0x1ff;
-    // 通过 va 得到三级页表项的索引
-    uint64_t third_index = (va_i >> 12) & 0x1ff;
-
-    // 如果一级页表项不存在，分配一个物理页面
-    if ((pgtbl[first_index] & PTE_V) == 0) {
-      // 分配一个物理页面
-      uint64_t *second_page = (uint64_t *)alloc_page();
-      // 设置一级页表项的内容
-      pgtbl[first_index] = (((uint64_t)second_page >> 12) << 10) |
-                           PTE_V /*| (perm & (PTE_U | PTE_V))*/;
-    }
-    // 通过一级页表项的内容得到二级页表的首地址
-    uint64_t *second_page = (uint64_t *)((pgtbl[first_index] >> 10) << 12);
-    // 如果二级页表项不存在，分配一个物理页面
-    if ((second_page[second_index] & PTE_V) == 0) {
-      // 分配一个物理页面
-      uint64_t *third_page = (uint64_t *)alloc_page();
-      // 设置二级页表项的内容
-      second_page[second_index] =
-          (((uint64_t)third_page >> 12) << 10) | (perm & (PTE_U | PTE_V));
+  uint64_t remain = ((sz - 1) / PAGE_SIZE + 1) * PAGE_SIZE;
+  bool superpage = vm_superpages && (perm & PTE_LEAF) && !(perm & PTE_U);
+
+  while (remain > 0) {
+    uint64_t *table = pgtbl;
+    int level = 2;
+    uint64_t size;
+    while (1) {
+      size = LEVEL_SIZE(level);
+      uint64_t *pte = &table[(va >> LEVEL_SHIFT(level)) & 0x1ff];
+      if (level == 0) {
+        // 设置三级页表项的内容
+        *pte = PA_TO_PTE(pa) | perm;
+        break;
+      }
+      if (superpage && ((va | pa) & (size - 1)) == 0 && remain >= size &&
+          (!(*pte & PTE_V) || (*pte & PTE_LEAF))) {
+        *pte = PA_TO_PTE(pa) | perm;
+        break;
+      }
+      if ((*pte & PTE_V) == 0) {
+        // 下一级页表不存在，分配一个物理页面
+        uint64_t next = alloc_page();
+        *pte = PA_TO_PTE(next) | PTE_V;
+      } else if (*pte & PTE_LEAF) {
+        split_leaf(pte, level);
+      }
+      table = (uint64_t *)PTE_TO_PA(*pte);
+      level--;
     }
-    // 通过二级页表项的内容得到三级页表的首地址
-    uint64_t *third_page =
-        (uint64_t *)((second_page[second_index] >> 10) << 12);
-    // 设置三级页表项的内容
-    third_page[third_index] = ((pa_i >> 12) << 10) | perm;
+    va += size;
+    pa += size;
+    remain -= size;
   }
 }
 
 uint64_t get_pte(uint64_t *pgtbl, uint64_t va) {
+  // 返回 va 所在 4KB 页面的页表项，如果 va 落在大页中，
+  // 返回的页表项的物理页号已经加上了 va 在大页内的偏移
+  uint64_t *table = pgtbl;
+  for (int level = 2; level > 0; level--) {
+    uint64_t pte = table[(va >> LEVEL_SHIFT(level)) & 0x1ff];
+    if ((pte & PTE_V) == 0) {
+      return 0;
+    }
+    if (pte & PTE_LEAF) {
+      return pte + PA_TO_PTE(va & (LEVEL_SIZE(level) - 1));
+    }
+    table = (uint64_t *)PTE_TO_PA(pte);
+  }
+  return table[(va >> LEVEL_SHIFT(0)) & 0x1ff];
+}
 
-  // 通过 va 得到一级页表项的索引
-  uint64_t first_index = (va >> 30) & 0x1ff;
-  // 通过 va 得到二级页表项的索引
-  uint64_t second_index = (va >> 21) & 0x1ff;
-  // 通过 va 得到三级页表项的索引
-  uint64_t third_index = (va >> 12) & 0x1ff;
+void free_pgtbl(uint64_t *pgtbl, int level) {
+  for (int i = 0; level > 0 && i < 512; i++) {
+    if ((pgtbl[i] & PTE_V) && !(pgtbl[i] & PTE_LEAF)) {
+      free_pgtbl((uint64_t *)PTE_TO_PA(pgtbl[i]), level - 1);
+    }
+  }
+  free_pages((uint64_t)pgtbl);
+}
 
-  if ((pgtbl[first_index] & PTE_V) == 0) {
-    return 0;
+// 返回 va 对应的三级页表项的地址，二级页表不存在时返回 NULL。用户空间只使用 4KB 页面
+static uint64_t *walk_pte(uint64_t *pgtbl, uint64_t va) {
+  uint64_t *table = pgtbl;
+  for (int level = 2; level > 0; level--) {
+    uint64_t pte = table[(va >> LEVEL_SHIFT(level)) & 0x1ff];
+    if ((pte & PTE_V) == 0 || (pte & PTE_LEAF)) {
+      return NULL;
+    }
+    table = (uint64_t *)PTE_TO_PA(pte);
   }
-  // 通过一级页表项的内容得到二级页表的首地址
-  uint64_t *second_page = (uint64_t *)((pgtbl[first_index] >> 10) << 12);
+  return &table[(va >> LEVEL_SHIFT(0)) & 0x1ff];
+}
 
-  if ((second_page[second_index] & PTE_V) == 0) {
+void copy_user_range(uint64_t dst_pgtbl, uint64_t src_pgtbl, uint64_t start,
+                     uint64_t end) {
+  // 子进程与父进程共享 [start, end) 中已经映射的页面，可写的页面在两边都改为只读
+  // 并标记 PTE_COW，第一次写入时由 do_cow_fault 复制。调用者需要刷新父进程的 TLB
+  for (uint64_t va = start & PAGE_MASK; va < end; va += PAGE_SIZE) {
+    uint64_t *pte = walk_pte((uint64_t *)src_pgtbl, va);
+    if (pte == NULL || (*pte & PTE_V) == 0) {
+      continue;
+    }
+    if (*pte & PTE_W) {
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+    }
+    get_page(PTE_TO_PA(*pte));
+    create_mapping((uint64_t *)dst_pgtbl, va, PTE_TO_PA(*pte), PAGE_SIZE,
+                   *pte & PTE_FLAGS);
+  }
+}
+
+void unmap_user_range(uint64_t pgtbl, uint64_t start, uint64_t end) {
+  for (uint64_t va = start & PAGE_MASK; va < end; va += PAGE_SIZE) {
+    uint64_t *pte = walk_pte((uint64_t *)pgtbl, va);
+    if (pte == NULL || (*pte & PTE_V) == 0) {
+      continue;
+    }
+    put_page(PTE_TO_PA(*pte));
+    *pte = 0;
+  }
+}
+
+uint64_t unmap_kernel_page(uint64_t va) {
+  uint64_t *pte = walk_pte(kernel_pgtbl, va);
+  if (pte == NULL || !(*pte & PTE_V)) {
     return 0;
   }
-  // 通过二级页表项的内容得到三级页表的首地址
-  uint64_t *third_page = (uint64_t *)((second_page[second_index] >> 10) << 12);
+  uint64_t pa = PTE_TO_PA(*pte);
+  *pte = 0;
+  flush_tlb_kernel_page(va);
+  return pa;
+}
+
+int do_cow_fault(uint64_t pgtbl, uint64_t va) {
+  uint64_t *pte = walk_pte((uint64_t *)pgtbl, va);
+  if (pte == NULL || (*pte & (PTE_V | PTE_COW)) != (PTE_V | PTE_COW)) {
+    return -1;
+  }
+
+  // 其他进程都已经不再共享该页面时直接恢复写权限，否则复制一份
+  uint64_t pa = PTE_TO_PA(*pte);
+  uint64_t flags = (*pte & PTE_FLAGS & ~PTE_COW) | PTE_W;
+  if (page_count(pa) > 1) {
+    uint64_t copy = alloc_user_pages(1, GFP_KERNEL);
+    if (copy == 0) {
+      return -1;
+    }
+    memcpy((void *)copy, (void *)pa, PAGE_SIZE);
+    put_page(pa);
+    pa = copy;
+  }
+  *pte = PA_TO_PTE(pa) | flags;
+  flush_tlb_page(va, mm_asid(&current->mm));
+  return 0;
+}
 
-  return third_page[third_index];
+int copy_to_user(void *dst, const void *src, size_t n) {
+  // 目标由用户给出，必须完整地落在用户地址范围内，否则可能被用来改写内核内存
+  uint64_t start = (uint64_t)dst, end = start + n;
+  if (end < start || end > USER_MMAP_END) {
+    return -1;
+  }
+  // 写入前先按写缺页处理目标范围内的每个页面：复制写时复制的页面，并为尚未
+  // 驻留的 VMA 页面分配物理页面。handler_s_kernel 虽然也能处理这些缺页，但无法
+  // 处理的缺页会直接停机，提前处理才能让无效的目标返回 -1
+  uint64_t pgtbl = SATP_PGTBL(current->satp);
+  for (uint64_t va = start & PAGE_MASK; va < end; va += PAGE_SIZE) {
+    if ((get_pte((uint64_t *)pgtbl, va) & (PTE_V | PTE_W)) != (PTE_V | PTE_W) &&
+        handle_mm_fault(va, CAUSE_STORE_PAGE_FAULT) != 0) {
+      return -1;
+    }
+  }
+  memcpy(dst, src, n);
+  return 0;
 }
 
-void paging_init() {
-  // 在 vm.c 中编写 paging_init 函数，该函数完成以下工作：
-  // 1. 创建内核的虚拟地址空间，调用 create_mapping 函数将虚拟地址
-  // 0xffffffc000000000 开始的 16 MB 空间映射到起始物理地址为 0x80000000 的 16MB
-  // 空间，PTE_V | PTE_R | PTE_W | PTE_X 为映射的读写权限。
-  // 2. 对内核起始地址 0x80000000 的16MB空间做等值映射（将虚拟地址 0x80000000
-  // 开始的 16 MB 空间映射到起始物理地址为 0x80000000 的 16MB 空间），PTE_V |
-  // PTE_R | PTE_W | PTE_X 为映射的读写权限。
-  // 3. 修改对内核空间不同 section
-  // 所在页属性的设置，完成对不同section的保护，其中text段的权限为 r-x, rodata
-  // 段为 r--, 其他段为 rw-，注意上述两个映射都需要做保护。
-  // 4. 将必要的硬件地址（如 0x10000000 为起始地址的 UART ）进行等值映射 (
-  // 可以映射连续 1MB 大小 )，无偏移，PTE_V | PTE_R 为映射的读写权限
-
-  // 注意：paging_init函数创建的页表只用于内核开启页表之后，进入第一个用户进程之前。进入第一个用户进程之后，就会使用进程页表，而不再使用
-  // paging_init 创建的页表。
-
-  uint64_t *pgtbl = alloc_page();
-  // DONE: 请完成你的代码
-  // 调用 create_mapping 函数将虚拟地址 0xffffffc000000000 开始的 16 MB
-  // 空间映射到起始物理地址为 0x80000000 的 16MB 空间
-  create_mapping(pgtbl, 0xffffffc000000000, 0x80000000, 16 * 1024 * 1024,
-                 PTE_V | PTE_R | PTE_W | PTE_X);
-  // 修改对内核空间不同 section
-  // 所在页属性的设置，完成对不同section的保护，其中text段的权限为 r-x, rodata
-  // 段为 r--, 其他段为 rw-。
-  create_mapping(pgtbl, 0xffffffc000000000, 0x80000000,
-                 (uint64_t)&rodata_start - 0x80000000, PTE_V | PTE_R | PTE_X);
-  create_mapping(
-      pgtbl, (uint64_t)&rodata_start - 0x80000000 + 0xffffffc000000000,
-      (uint64_t)&rodata_start, (uint64_t)&data_start - (uint64_t)&rodata_start,
-      PTE_V | PTE_R);
-  create_mapping(pgtbl, (uint64_t)&data_start - 0x80000000 + 0xffffffc000000000,
-                 (uint64_t)&data_start, (uint64_t)&_end - (uint64_t)&data_start,
-                 PTE_V | PTE_R | PTE_W);
-  // 对内核起始地址 0x80000000 的16MB空间做等值映射（将虚拟地址 0x80000000
-  // 开始的 16 MB 空间映射到起始物理地址为 0x80000000 的 16MB 空间）
-  create_mapping(pgtbl, 0x80000000, 0x80000000, 16 * 1024 * 1024,
-                 PTE_V | PTE_R | PTE_W | PTE_X);
-  // 修改对内核空间不同 section
-  // 所在页属性的设置，完成对不同section的保护，其中text段的权限为 r-x, rodata
-  // 段为 r--, 其他段为 rw-。
-  create_mapping(pgtbl, 0x80000000, 0x80000000,
-                 (uint64_t)&rodata_start - 0x80000000, PTE_V | PTE_R | PTE_X);
-  create_mapping(pgtbl, (uint64_t)&rodata_start, (uint64_t)&rodata_start,
-                 (uint64_t)&data_start - (uint64_t)&rodata_start,
-                 PTE_V | PTE_R);
-  create_mapping(pgtbl, (uint64_t)&data_start, (uint64_t)&data_start,
-                 (uint64_t)&_end - (uint64_t)&data_start,
-                 PTE_V | PTE_R | PTE_W);
-  // 将必要的硬件地址（如 0x10000000 为起始地址的 UART ）进行等值映射 (
-  // 可以映射连续 1MB 大小 )，无偏移，3 为映射的读写权限
+void map_kernel_space(uint64_t *pgtbl) {
+  // 内核空间由内核页表和所有用户页表共享：
+  // 1. 将虚拟地址 0xffffffc000000000 开始的空间映射到从 0x80000000 开始的全部物理内存，
+  //    并对 0x80000000 开始的全部物理内存做等值映射，PTE_G | PTE_V | PTE_R | PTE_W | PTE_X 为映射的读写权限
+  // 2. 修改对内核空间不同 section 所在页属性的设置，其中text段的权限为 r-x, rodata
+  //    段为 r--, 其他段为 rw-，注意上述两个映射都需要做保护
+  // 3. 将 UART、virtio（0x10000000 开始的 1MB）和 PLIC 进行等值映射
+  // 4. 内核空间的映射在所有进程中都相同，全部标记为 PTE_G，切换 ASID 时保留在 TLB 中
+  // 打开 MMU 前后都会调用该函数，因此先统一转换成物理地址
+  uint64_t mem_base = boot_info.mem_base;
+  uint64_t mem_size = boot_info.mem_size;
+  uint64_t text = PHYSICAL_ADDR((uint64_t)&text_start);
+  uint64_t rodata = PHYSICAL_ADDR((uint64_t)&rodata_start);
+  uint64_t data = PHYSICAL_ADDR((uint64_t)&data_start);
+  uint64_t end = PHYSICAL_ADDR((uint64_t)&_end);
+
+  create_mapping(pgtbl, VIRTUAL_ADDR(mem_base), mem_base, mem_size,
+                 PTE_G | PTE_V | PTE_R | PTE_W | PTE_X);
+  create_mapping(pgtbl, VIRTUAL_ADDR(text), text, rodata - text,
+                 PTE_G | PTE_V | PTE_R | PTE_X);
+  create_mapping(pgtbl, VIRTUAL_ADDR(rodata), rodata, data - rodata,
+                 PTE_G | PTE_V | PTE_R);
+  create_mapping(pgtbl, VIRTUAL_ADDR(data), data, end - data,
+                 PTE_G | PTE_V | PTE_R | PTE_W);
+
+  create_mapping(pgtbl, mem_base, mem_base, mem_size,
+                 PTE_G | PTE_V | PTE_R | PTE_W | PTE_X);
+  create_mapping(pgtbl, text, text, rodata - text, PTE_G | PTE_V | PTE_R | PTE_X);
+  create_mapping(pgtbl, rodata, rodata, data - rodata, PTE_G | PTE_V | PTE_R);
+  create_mapping(pgtbl, data, data, end - data, PTE_G | PTE_V | PTE_R | PTE_W);
+
   create_mapping(pgtbl, 0x10000000, 0x10000000, 1 * 1024 * 1024,
-                 PTE_V | PTE_R | PTE_W | PTE_X);
-  
-  create_mapping(pgtbl, 0x0c000000L, 0x0c000000L, 20 * 1024 * 1024, PTE_V | PTE_R | PTE_W | PTE_X);
+                 PTE_G | PTE_V | PTE_R | PTE_W | PTE_X);
+  create_mapping(pgtbl, 0x0c000000L, 0x0c000000L, 20 * 1024 * 1024,
+                 PTE_G | PTE_V | PTE_R | PTE_W | PTE_X);
+}
+
+uint64_t new_user_pgtbl() {
+  // 内核空间在 paging_init 中只建立一次，新的根页表直接复制内核页表的顶层页表项，
+  // 这样内核空间的二、三级页表由所有进程共享，fork 只需要为用户空间分配页表。
+  // 用户程序所在的第 0 个 1GB 与 UART、PLIC 共用同一个顶层页表项，这一项对应的
+  // 二级页表需要复制一份私有的，其中的内核页表项仍指向共享的三级页表
+  uint64_t *root = (uint64_t *)alloc_pages_flags(1, GFP_KERNEL);
+  memcpy(root, kernel_pgtbl, PAGE_SIZE);
+
+  uint64_t low = kernel_pgtbl[USER_ROOT_INDEX];
+  if ((low & PTE_V) && !(low & PTE_LEAF)) {
+    uint64_t second = alloc_pages_flags(1, GFP_KERNEL);
+    memcpy((void *)second, (void *)PTE_TO_PA(low), PAGE_SIZE);
+    root[USER_ROOT_INDEX] = PA_TO_PTE(second) | PTE_V;
+  }
+  return (uint64_t)root;
+}
+
+// 释放 pgtbl 中不与内核页表模板 tmpl 共享的页表页面，tmpl 为 NULL 时全部释放
+static void free_private_pgtbl(uint64_t *pgtbl, uint64_t *tmpl, int level) {
+  for (int i = 0; level > 0 && i < 512; i++) {
+    uint64_t pte = pgtbl[i];
+    if (!(pte & PTE_V) || (pte & PTE_LEAF) || (tmpl && pte == tmpl[i])) {
+      continue;
+    }
+    uint64_t *sub_tmpl = NULL;
+    if (tmpl && (tmpl[i] & PTE_V) && !(tmpl[i] & PTE_LEAF)) {
+      sub_tmpl = (uint64_t *)PTE_TO_PA(tmpl[i]);
+    }
+    free_private_pgtbl((uint64_t *)PTE_TO_PA(pte), sub_tmpl, level - 1);
+  }
+  free_pages((uint64_t)pgtbl);
+}
+
+void free_user_pgtbl(uint64_t pgtbl) {
+  free_private_pgtbl((uint64_t *)pgtbl, kernel_pgtbl, 2);
+}
+
+uint64_t paging_init(uint64_t dtb_addr) {
+  // 在 vm.c 中编写 paging_init 函数，该函数完成以下工作：
+  // 1. 解析固件传入的设备树，得到物理内存的大小，buddy system 和直接映射都据此确定
+  // 2. 创建内核的虚拟地址空间，见 map_kernel_space
+  // 3. 返回根页表的物理地址，由 head.S 写入 satp
+
+  // 注意：paging_init函数创建的页表在进入第一个用户进程之前使用，之后作为模板，
+  // 由 new_user_pgtbl 把其中的内核空间共享给每个进程页表。
+
+  parse_dtb(dtb_addr);
+
+  kernel_pgtbl = (uint64_t *)alloc_page();
+  map_kernel_space(kernel_pgtbl);
+  // vmalloc 区的二级页表在复制任何进程页表之前建好，之后只会往下填写
+  kernel_pgtbl[VMALLOC_ROOT_INDEX] = PA_TO_PTE(alloc_page()) | PTE_V;
+  return (uint64_t)kernel_pgtbl;
+}
+
+void flush_tlb_range(uint64_t asid, uint64_t start, uint64_t end) {
+  if ((end - start) / PAGE_SIZE > TLB_FLUSH_PAGE_LIMIT) {
+    flush_tlb_asid(asid);
+    return;
+  }
+  for (uint64_t va = start & PAGE_MASK; va < end; va += PAGE_SIZE) {
+    flush_tlb_page(va, asid);
+  }
+}
+
+void asid_init(void) {
+  // 向 satp 的 ASID 字段写入全 1 再读回，未实现的位读出为 0
+  uint64_t satp = read_csr(satp);
+  write_csr(satp, satp | (((1UL << SATP_ASID_MAX_BITS) - 1) << SATP_ASID_SHIFT));
+  uint64_t mask = read_csr(satp) >> SATP_ASID_SHIFT;
+  write_csr(satp, satp);
+  local_flush_tlb_all();
+
+  asid_bits = 0;
+  while (asid_bits < SATP_ASID_MAX_BITS && (mask & (1UL << asid_bits))) {
+    asid_bits++;
+  }
+  asid_generation = 1UL << asid_bits;
+  next_asid = 1;
+}
+
+uint64_t mm_asid(struct mm_struct *mm) {
+  return mm->context_id & ((1UL << asid_bits) - 1);
+}
+
+// 为 mm 分配当前代的 ASID，调用者持有 asid_lock。用完一代时通知所有 hart 刷新 TLB
+static void new_context(struct mm_struct *mm) {
+  if (next_asid == (1UL << asid_bits)) {
+    // 进入下一代，之前分配的 ASID 全部作废，各进程在下次被调度时重新分配。
+    // 其他 hart 上正在运行的进程仍使用旧的 ASID，它们的 TLB 在下一次切换时才刷新
+    asid_generation += 1UL << asid_bits;
+    next_asid = 1;
+    for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+      tlb_flush_pending[cpu] = 1;
+    }
+  }
+  mm->context_id = asid_generation | next_asid++;
+}
+
+void switch_mm(struct task_struct *next) {
+  // ASID 与 pid 无关，退出进程的 ASID 在进入下一代之前不会被复用，
+  // 因此切换时不需要刷新 TLB。硬件不支持 ASID 时每一代只有一个 ASID，
+  // 切换到不同的地址空间都会进入下一代并刷新 TLB
+  struct mm_struct *mm = &next->mm;
+  int cpu = smp_processor_id();
+
+  // 空闲进程只使用内核页表，内核映射都是 PTE_G，与 ASID 无关
+  if (SATP_PGTBL(next->satp) == (uint64_t)kernel_pgtbl) {
+    write_csr(satp, next->satp);
+    return;
+  }
+
+  spin_lock(&asid_lock);
+  bool fresh = (mm->context_id ^ asid_generation) >> asid_bits;
+  if (fresh) {
+    new_context(mm);
+  }
+  bool flush = tlb_flush_pending[cpu];
+  tlb_flush_pending[cpu] = 0;
+  spin_unlock(&asid_lock);
+
+  // 进程只在自己运行的 hart 上刷新 TLB，换到别的 hart 再回来时，
+  // 这里可能还留着它之前在本 hart 上运行时的旧映射
+  bool stale = !fresh && mm->last_cpu != cpu;
+  mm->last_cpu = cpu;
+
+  next->satp = MAKE_SATP(SATP_PGTBL(next->satp), mm_asid(mm));
+  write_csr(satp, next->satp);
+  if (flush) {
+    local_flush_tlb_all();
+  } else if (stale) {
+    flush_tlb_asid(mm_asid(mm));
+  }
 }
@@ -0,0 +1,140 @@
+#include "vmalloc.h"
+
+#include "mm.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "stdio.h"
+
+// vmalloc 区中的一段已分配的区间，后面紧跟一页不映射的保护页，
+// 越界访问会触发异常，而不是悄悄写坏相邻的区间
+struct vm_struct {
+  struct list_head list;
+  uint64_t addr;
+  unsigned long nr_pages; // 不含保护页
+};
+
+// 已分配的区间按地址排序，新区间放在第一个足够大的空隙中
+static LIST_HEAD(vmap_area_list);
+static spinlock_t vmap_lock = SPINLOCK_INIT;
+
+#define AREA_END(area) ((area)->addr + ((area)->nr_pages + 1) * PAGE_SIZE)
+
+// 为 area 在 vmalloc 区中找一段空闲的虚拟地址，失败时返回 -1
+static int alloc_vmap_area(struct vm_struct *area) {
+  uint64_t size = (area->nr_pages + 1) * PAGE_SIZE;
+  uint64_t addr = VMALLOC_START;
+  struct vm_struct *v;
+  int ret = -1;
+
+  unsigned long flags = spin_lock_irqsave(&vmap_lock);
+  list_for_each_entry(v, &vmap_area_list, list) {
+    if (v->addr - addr >= size) {
+      break;
+    }
+    addr = AREA_END(v);
+  }
+  // 遍历完时 &v->list 就是链表头，插在它之前即插在链表末尾
+  if (&v->list != &vmap_area_list || VMALLOC_END - addr >= size) {
+    area->addr = addr;
+    list_add_tail(&area->list, &v->list);
+    ret = 0;
+  }
+  spin_unlock_irqrestore(&vmap_lock, flags);
+  return ret;
+}
+
+// 解除 [addr, addr + nr * PAGE_SIZE) 的映射并释放其中的物理页面
+static void unmap_vmap_pages(uint64_t addr, unsigned long nr) {
+  for (unsigned long i = 0; i < nr; i++) {
+    uint64_t pa = unmap_kernel_page(addr + i * PAGE_SIZE);
+    if (pa != 0) {
+      free_pages(pa);
+    }
+  }
+}
+
+static void *__vmalloc(size_t size, unsigned int gfp) {
+  if (size == 0 || size >= VMALLOC_END - VMALLOC_START) {
+    return NULL;
+  }
+  struct vm_struct *area = kmalloc(sizeof(struct vm_struct));
+  if (area == NULL) {
+    return NULL;
+  }
+  area->nr_pages = (size - 1) / PAGE_SIZE + 1;
+  if (alloc_vmap_area(area) != 0) {
+    kfree(area);
+    return NULL;
+  }
+
+  // 逐页分配，单页请求可以落在任何空闲的 0 阶块上，不需要连续的大块
+  for (unsigned long i = 0; i < area->nr_pages; i++) {
+    uint64_t pa = alloc_pages_flags(1, gfp);
+    if (pa == 0) {
+      unmap_vmap_pages(area->addr, i);
+      unsigned long flags = spin_lock_irqsave(&vmap_lock);
+      list_del(&area->list);
+      spin_unlock_irqrestore(&vmap_lock, flags);
+      kfree(area);
+      return NULL;
+    }
+    create_mapping(kernel_pgtbl, area->addr + i * PAGE_SIZE, pa, PAGE_SIZE,
+                   PTE_G | PTE_V | PTE_R | PTE_W);
+  }
+  return (void *)area->addr;
+}
+
+void *vmalloc(size_t size) {
+  return __vmalloc(size, GFP_KERNEL);
+}
+
+void *vzalloc(size_t size) {
+  return __vmalloc(size, GFP_ZERO);
+}
+
+void vfree(const void *addr) {
+  struct vm_struct *v, *area = NULL;
+
+  if (addr == NULL) {
+    return;
+  }
+  unsigned long flags = spin_lock_irqsave(&vmap_lock);
+  list_for_each_entry(v, &vmap_area_list, list) {
+    if (v->addr == (uint64_t)addr) {
+      area = v;
+      break;
+    }
+  }
+  spin_unlock_irqrestore(&vmap_lock, flags);
+
+  if (area == NULL) {
+    printf("error: vfree %lx is not a vmalloc area\n", (uint64_t)addr);
+    while(1);
+    return;
+  }
+  unmap_vmap_pages(area->addr, area->nr_pages);
+
+  // 其他 hart 的 TLB 中可能还有这段地址的全局映射，只有继续使用已经释放的地址才会
+  // 经过它们，因此在这段地址被重新分配之前刷新即可
+  smp_flush_tlb_others();
+  flags = spin_lock_irqsave(&vmap_lock);
+  list_del(&area->list);
+  spin_unlock_irqrestore(&vmap_lock, flags);
+  kfree(area);
+}
+
+void *kvmalloc(size_t size) {
+  return size <= PAGE_SIZE ? kmalloc(size) : vmalloc(size);
+}
+
+void *kvzalloc(size_t size) {
+  return size <= PAGE_SIZE ? kzalloc(size) : vzalloc(size);
+}
+
+void kvfree(const void *addr) {
+  if (is_vmalloc_addr(addr)) {
+    vfree(addr);
+  } else {
+    kfree(addr);
+  }
+}
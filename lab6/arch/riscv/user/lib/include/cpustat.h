@@ -0,0 +1,11 @@
+#pragma once
+#include "types.h"
+
+// 一个 hart 自上线以来在空闲进程中和在其他进程中的时间，单位为 mtime 的计数
+struct cpu_stat {
+  uint64_t idle;
+  uint64_t busy;
+};
+
+// 填入 hart 0 到 n-1 的统计，未上线的 hart 全为 0，返回填入的个数，stat 不可写时返回 -1
+int cpustat(struct cpu_stat *stat, int n);
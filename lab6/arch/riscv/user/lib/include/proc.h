@@ -3,6 +3,9 @@
 #include "syscall.h"
 
 int fork();
+// 等待子进程 pid（-1 表示任意子进程）退出，status 非空时写入其退出码，
+// 返回回收的子进程的 pid，没有这样的子进程时返回 -1
+int waitpid(int pid, int *status);
 void wait(int pid);
 void exit(int ret);
 void exec(const char * path);
\ No newline at end of file
@@ -17,6 +17,11 @@
 #define SFS_WRITE     1005
 #define SFS_GET_FILES 1006
 
+// mtime 每秒的计数，来自设备树
+#define SYS_TIMEBASE  1101
+// 各 hart 的空闲和忙碌时间
+#define SYS_CPUSTAT   1102
+
 #include "types.h"
 
 struct ret_info {
@@ -0,0 +1,5 @@
+#pragma once
+#include "types.h"
+
+// mtime 每秒的计数，用于把 rdtime 读到的值换算成时间
+uint64_t timebase();
@@ -0,0 +1,7 @@
+#include "cpustat.h"
+#include "syscall.h"
+
+int cpustat(struct cpu_stat *stat, int n) {
+  struct ret_info ret = u_syscall(SYS_CPUSTAT, (uint64_t)stat, n, 0, 0, 0, 0);
+  return (int)ret.a0;
+}
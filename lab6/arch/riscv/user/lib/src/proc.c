@@ -6,8 +6,13 @@ int fork() {
   return ret.a0;
 }
 
+int waitpid(int pid, int *status) {
+  struct ret_info ret = u_syscall(SYS_WAIT, pid, (uint64_t)status, 0, 0, 0, 0);
+  return ret.a0;
+}
+
 void wait(int pid) {
-  u_syscall(SYS_WAIT, pid, 0, 0, 0, 0, 0);
+  waitpid(pid, 0);
 }
 
 void exit(int ret) {
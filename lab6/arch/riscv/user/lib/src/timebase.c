@@ -0,0 +1,7 @@
+#include "timebase.h"
+#include "syscall.h"
+
+uint64_t timebase() {
+  struct ret_info ret = u_syscall(SYS_TIMEBASE, 0, 0, 0, 0, 0, 0);
+  return ret.a0;
+}
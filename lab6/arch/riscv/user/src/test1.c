@@ -2,12 +2,14 @@
 #include "stdio.h"
 #include "getpid.h"
 #include "getchar.h"
+#include "cpustat.h"
 
 int strcmp(const char *a, const char *b);
 int getchar_until_valid();
+void print_cpustat();
 
 int main() {
-  char program[][10] = {"hello", "read", "test", "fssh"};
+  char program[][10] = {"hello", "read", "test", "fssh", "forkbomb"};
   char input[64];
   int n = 0, ch;
 
@@ -39,12 +41,14 @@ input_end:
 
     // exec user's instruction
     if (strcmp(input, "ls") == 0) {
-      for (int i = 0; i < 4; i++) {
+      for (int i = 0; i < 5; i++) {
         printf("%s ", program[i]);
       }
       printf("\n");
+    } else if (strcmp(input, "cpustat") == 0) {
+      print_cpustat();
     } else {
-      for (int i = 0; i < 4; i++) {
+      for (int i = 0; i < 5; i++) {
         if (strcmp(input, program[i]) == 0) {
           int ret = fork();
           if (ret == 0) {
@@ -87,3 +91,16 @@ int getchar_until_valid() {
   return ch;
 }
 
+void print_cpustat() {
+  struct cpu_stat stat[8];
+  int n = cpustat(stat, 8);
+  for (int i = 0; i < n; i++) {
+    unsigned long total = stat[i].idle + stat[i].busy;
+    if (total == 0) {
+      continue;
+    }
+    // printf 不支持 %%，直接写出 percent
+    printf("hart %d: idle %d percent, busy %d percent\n", i,
+           (int)(stat[i].idle * 100 / total), (int)(stat[i].busy * 100 / total));
+  }
+}
@@ -0,0 +1,71 @@
+#include "proc.h"
+#include "stdio.h"
+#include "timebase.h"
+#include "types.h"
+
+// fork 炸弹：以二叉树的方式 fork 出 2^DEPTH 个叶子进程，每个叶子做同样的纯计算，
+// 中间节点等待两个子进程后退出。先在一个进程中串行完成同样的计算作为对照，
+// 用 make run SMP=n 比较不同 hart 数下的加速比
+#define DEPTH 4
+#define LEAVES (1 << DEPTH)
+#define WORK 1000000
+#define ROUNDS 3
+
+static inline uint64_t rdtime() {
+  uint64_t t;
+  asm volatile("rdtime %0" : "=r"(t));
+  return t;
+}
+
+static void work() {
+  volatile uint64_t sum = 0;
+  for (uint64_t i = 0; i < WORK; i++)
+    sum += i;
+}
+
+static void spawn(int depth) {
+  if (depth == 0) {
+    work();
+    exit(0);
+  }
+  int left = fork();
+  if (left == 0)
+    spawn(depth - 1);
+  int right = fork();
+  if (right == 0)
+    spawn(depth - 1);
+  wait(left);
+  wait(right);
+  exit(0);
+}
+
+// mtime 的频率由内核从设备树中读出
+static uint64_t timebase_hz;
+
+static uint64_t to_us(uint64_t t) {
+  return t * 1000000 / timebase_hz;
+}
+
+int main() {
+  timebase_hz = timebase();
+  uint64_t start = rdtime();
+  for (int i = 0; i < LEAVES; i++)
+    work();
+  uint64_t serial = rdtime() - start;
+  printf("[forkbomb] serial %d x work: %d us\n", LEAVES, (int)to_us(serial));
+
+  for (int round = 0; round < ROUNDS; round++) {
+    start = rdtime();
+    int pid = fork();
+    if (pid == 0)
+      spawn(DEPTH);
+    wait(pid);
+    uint64_t parallel = rdtime() - start;
+    // 加速比保留两位小数
+    uint64_t speedup = serial * 100 / parallel;
+    printf("[forkbomb] round %d: %d processes, %d us, speedup %d.%d%d\n", round,
+           2 * LEAVES - 1, (int)to_us(parallel), (int)(speedup / 100),
+           (int)(speedup / 10 % 10), (int)(speedup % 10));
+  }
+  return 0;
+}
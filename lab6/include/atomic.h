@@ -0,0 +1,60 @@
+#pragma once
+
+#include "defs.h"
+
+// 阻止编译器跨越该点重排内存访问，同一 hart 上（包括中断）的可见性只需要这一点
+#define barrier() asm volatile("" : : : "memory")
+
+#define READ_ONCE(x) (*(volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, val) (*(volatile typeof(x) *)&(x) = (val))
+
+// 多个 hart 之间的完整内存屏障
+#define smp_mb() asm volatile("fence rw, rw" : : : "memory")
+
+// 原子地把 *ptr 加上 val，返回原来的值，带有完整的内存屏障
+static inline int atomic_fetch_add(volatile int *ptr, int val) {
+  int ret;
+  asm volatile("amoadd.w.aqrl %0, %2, %1"
+               : "=r"(ret), "+A"(*ptr)
+               : "r"(val)
+               : "memory");
+  return ret;
+}
+
+// 原子地置位、清除 *ptr 中的位，返回原来的值，带有完整的内存屏障
+static inline uint64_t atomic_fetch_or64(volatile uint64_t *ptr,
+                                         uint64_t mask) {
+  uint64_t ret;
+  asm volatile("amoor.d.aqrl %0, %2, %1"
+               : "=r"(ret), "+A"(*ptr)
+               : "r"(mask)
+               : "memory");
+  return ret;
+}
+
+static inline uint64_t atomic_fetch_and64(volatile uint64_t *ptr,
+                                          uint64_t mask) {
+  uint64_t ret;
+  asm volatile("amoand.d.aqrl %0, %2, %1"
+               : "=r"(ret), "+A"(*ptr)
+               : "r"(mask)
+               : "memory");
+  return ret;
+}
+
+// 若 *ptr == old 则写入 new，返回 *ptr 原来的值。使用 A 扩展的 LR/SC 实现，
+// 成功时带有完整的内存屏障
+static inline uint64_t cmpxchg64(volatile uint64_t *ptr, uint64_t old,
+                                 uint64_t new) {
+  uint64_t ret, fail;
+  asm volatile("0: lr.d %0, %2\n"
+               "   bne %0, %3, 1f\n"
+               "   sc.d.rl %1, %4, %2\n"
+               "   bnez %1, 0b\n"
+               "   fence rw, rw\n"
+               "1:\n"
+               : "=&r"(ret), "=&r"(fail), "+A"(*ptr)
+               : "r"(old), "r"(new)
+               : "memory");
+  return ret;
+}
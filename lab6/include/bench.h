@@ -0,0 +1,47 @@
+#pragma once
+
+#include "defs.h"
+
+// 内核微基准测试，仅在以 make BENCH=1 编译时由 start_kernel 调用
+
+/* buddy system 分配/释放吞吐量 */
+void bench_buddy(void);
+
+/* memcpy/memset/memcmp 与逐字节实现的对比，覆盖对齐和错位的情况 */
+void bench_string(void);
+
+/* 使用大页和只使用 4KB 页面建立内核空间的开销，以及访问直接映射区时的 TLB 缺失开销 */
+void bench_paging(void);
+
+/* fork 时建立进程页表的开销：共享内核页表模板与为每个进程重建内核空间的对比 */
+void bench_user_pgtbl(void);
+
+/* 大量 VMA 时 find_vma 的开销：AVL 树与顺序遍历链表的对比，以及相邻 VMA 的合并 */
+void bench_vma(void);
+
+/* 进程切换后访问内核空间的开销：每次切换都刷新 TLB 与 ASID 加全局内核映射的对比 */
+void bench_asid(void);
+
+/* 随机大小的 kmalloc/kfree 混合负载下 slub 分配器的吞吐量 */
+void bench_slub(void);
+
+/* kmalloc 与 kzalloc 的对比：不需要清零时节省的开销 */
+void bench_kzalloc(void);
+
+/* 多页缓冲区：按 2 的幂分配、精确页数分配与 vmalloc 占用的页面数和开销的对比 */
+void bench_vmalloc(void);
+
+/* 内存不足时 shrinker 从 slub 等缓存中回收的页面数和开销 */
+void bench_shrink(void);
+
+/* 选择下一个进程的开销：扫描整个进程表与优先级运行队列的对比 */
+void bench_runqueue(void);
+
+/* pid 的分配和释放，以及按 pid 查找进程：两级 pid 表与扫描进程表的对比 */
+void bench_pid(void);
+
+/* 进程切换时保存和恢复全部浮点寄存器的开销，即不按需切换时每次切换多付出的开销 */
+void bench_fpu(void);
+
+/* 依次运行所有基准测试 */
+void run_benchmarks(void);
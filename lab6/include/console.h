@@ -0,0 +1,7 @@
+#pragma once
+
+// 串口输入。UART 的接收中断没有转发给 S 模式，有进程在等待输入时
+// 由一个每 tick 到期一次的定时器检查接收寄存器，没有进程等待时不检查
+
+// 读取一个字符，没有输入时当前进程睡眠，直到读到为止
+int console_getchar(void);
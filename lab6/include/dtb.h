@@ -0,0 +1,41 @@
+#pragma once
+
+#include "defs.h"
+
+// 设备树（Flattened Device Tree）中的常量，所有字段均为大端序
+#define FDT_MAGIC 0xd00dfeed
+#define FDT_BEGIN_NODE 0x1
+#define FDT_END_NODE 0x2
+#define FDT_PROP 0x3
+#define FDT_NOP 0x4
+#define FDT_END 0x9
+
+// 物理内存的起始地址，内核被加载在这里
+#define PHYS_MEM_BASE 0x80000000UL
+// 没有拿到设备树时使用的内存大小
+#define DEFAULT_MEMORY_SIZE 0x1000000UL
+// PHYSICAL_ADDR/VIRTUAL_ADDR 只能覆盖 [0x80000000, 0x100000000)，更多的内存会被忽略
+#define MAX_MEMORY_SIZE 0x80000000UL
+
+// 没有拿到设备树时使用的 mtime 频率，与 QEMU virt 相同
+#define DEFAULT_TIMEBASE_FREQ 10000000UL
+// 时钟中断的默认频率，可以用 make TICK_HZ=... 修改，也可以在 /chosen 的 bootargs 中用
+// tick_hz=... 指定
+#ifndef CONFIG_TICK_HZ
+#define CONFIG_TICK_HZ 10
+#endif
+
+// 启动时从设备树中解析出的信息
+struct boot_info {
+  uint64_t dtb_addr;
+  uint64_t mem_base;
+  uint64_t mem_size;
+  uint64_t timebase_freq; // /cpus 的 timebase-frequency，即 mtime 每秒增加的值
+  uint64_t tick_hz;       // 每秒的时钟中断数
+  uint64_t nr_cpus;       // /cpus 下 cpu 节点的数量，不超过 NR_CPUS
+};
+
+extern struct boot_info boot_info;
+
+// 解析固件通过 a1 传入的设备树，在打开 MMU 之前由 paging_init 调用
+void parse_dtb(uint64_t dtb_addr);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "defs.h"
+
+/* 浮点寄存器 f0-f31 和 fcsr 的保存区，放在 task_struct 中 */
+struct fp_state {
+  uint64_t f[32];
+  uint64_t fcsr;
+};
+
+struct task_struct;
+
+/* 切换进程时调用。prev 这次运行中写过浮点寄存器（FS 为 Dirty）时保存到 prev->fp；
+   next 的浮点状态仍在本 hart 的寄存器中时把 FS 设为 Clean，否则设为 Off，
+   等 next 第一次执行浮点指令时由 fp_trap 恢复。不使用浮点的进程没有任何额外开销 */
+void fp_switch(struct task_struct *prev, struct task_struct *next);
+
+/* 非法指令异常的处理：FS 为 Off 时认为是浮点指令，恢复当前进程的浮点状态后返回 1，
+   返回用户态后重新执行这条指令；FS 已经打开时返回 0，是真正的非法指令 */
+bool fp_trap(void);
+
+/* fork 之前调用：把当前进程在寄存器中的浮点状态写回 current->fp，子进程复制它 */
+void fp_flush(void);
+
+/* exec 时调用：当前进程的浮点状态恢复为全 0 */
+void fp_reset(void);
+
+/* 见 entry.S，调用前 FS 不能为 Off */
+extern void __fp_save(struct fp_state *fp);
+extern void __fp_restore(struct fp_state *fp);
@@ -2,6 +2,7 @@
 
 #include "defs.h"
 #include "list.h"
+#include "spinlock.h"
 
 #define SFS_MAX_INFO_LEN     32
 #define SFS_MAGIC            0x1f2f3f4f
@@ -64,6 +65,12 @@ struct sfs_memory_block {
     struct list_head inode_link; // 在 sfs_fs 内 inode_list 链表中的位置 （可根据自己的数据结构设计自行修改）
 };
 
+/**
+ * 文件系统的全局锁，系统调用在调用下列 sfs_* 函数时持有，
+ * 块缓存、空闲块位图和磁盘请求同一时间只由一个 hart 访问
+ */
+extern spinlock_t sfs_lock;
+
 /**
  * 功能: 初始化 simple file system
  * @ret : 成功初始化返回 0，否则返回非 0 值
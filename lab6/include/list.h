@@ -423,6 +423,21 @@ static __inline__ void list_move_tail(struct list_head *node,
 #define list_for_each_entry(entry, head, member) \
   list_for_each_entry_t(entry, head, __typeof__(*entry), member)
 
+/**
+ * list_for_each_entry_reverse - iterate backwards over list entries
+ * @entry: pointer used as iterator
+ * @head: pointer to the head of the list
+ * @member: name of the list_head member variable in struct type of @entry
+ *
+ * The nodes and the head of the list must must be kept unmodified while
+ * iterating through it. Any modifications to the the list will cause undefined
+ * behavior.
+ */
+#define list_for_each_entry_reverse(entry, head, member)                 \
+  for (entry = list_entry((head)->prev, __typeof__(*entry), member);     \
+       &entry->member != (head);                                         \
+       entry = list_entry(entry->member.prev, __typeof__(*entry), member))
+
 /**
  * list_for_each_safe - iterate over list nodes and allow deletes
  * @node: list_head pointer used as iterator
@@ -1,37 +1,102 @@
 #pragma once
 
 #include "defs.h"
+#include "list.h"
+#include "string.h"
 #include "slub.h"
 #include "vm.h"
 
 #define PAGE_SIZE 4096UL
 
-// 定义buddy system可分配的内存大小为16MB
-#define MEMORY_SIZE 0x1000000
+// 空闲链表的阶数范围为 [0, MAX_ORDER)，最大的块为 2^(MAX_ORDER-1) 个页面，
+// 即 64MB，足够容纳 2GB 内存对应的 struct page 数组
+#define MAX_ORDER 15
+
+// alloc_pages_flags 的分配标志
+#define GFP_KERNEL 0x0 // 不关心页面内容，调用者会自行覆盖
+#define GFP_ZERO 0x1   // 返回全零的页面
+
+// 预先清零的单页池，在 CPU 空闲时补充
+#define ZERO_POOL_SIZE 64
 
 extern uint64_t _end;
 
 static uint64_t alloc_page_num = 0;
 
+// 每个阶对应一条空闲链表，链表中的块大小均为 2^order 个页面
+struct free_area {
+  struct list_head free_list;
+  unsigned long nr_free;
+};
+
 typedef struct {
   bool initialized;
   uint64_t base_addr;
-  unsigned int bitmap[8192];
+  uint64_t nr_pages;
+  struct free_area free_area[MAX_ORDER];
+  // 以下两个数组的长度为 nr_pages，启动时根据内存大小放在 _end 之后
+  // 以页框号为下标，记录以该页为首的块的阶数，空闲块额外带有 BUDDY_FREE 标记
+  unsigned char *order;
+  // 以页框号为下标，空闲块首页挂在 free_area 链表上的节点
+  // 节点不放在空闲页面内部，因此分配器不会读写未分配的内存
+  struct list_head *link;
 } buddy;
 
-static buddy buddy_system;
-
 int alloced_page_num();
 
+// buddy system 管理的第一个页面的物理地址，以及管理的页面数
+uint64_t buddy_base_addr();
+uint64_t buddy_nr_pages();
+
 void init_buddy_system();
 
+uint64_t alloc_pages_flags(unsigned int num, unsigned int flags);
+
 uint64_t alloc_pages(unsigned int num);
 
 uint64_t alloc_page();
 
+// 分配恰好 num 个物理连续的页面，向上取整到 2 的幂后多出的页面立即归还，
+// 必须用 free_pages_exact 以相同的 num 释放
+uint64_t alloc_pages_exact(unsigned int num, unsigned int flags);
+void free_pages_exact(uint64_t pa, unsigned int num);
+
+// 补充预清零页面池，最多补充 batch 个页面，返回池中的页面数
+int refill_zero_pool(int batch);
+
+// 把预清零页面池中的页面全部归还给 buddy system
+void drain_zero_pool();
+
 void free_pages(uint64_t pa);
 
+// 内存不足时的回收回调。buddy system 分配失败时先清空预清零池，
+// 再依次调用已注册的 shrinker，只要有页面被回收就重试分配
+struct shrinker {
+  const char *name;
+  // 尽量回收 nr_to_scan 个页面，返回本次释放的页面数（上层缓存返回释放的对象占用的页面数），
+  // 没有可回收的内容时返回 0。
+  // 可能在任何分配内存的地方被调用，不能再分配内存
+  unsigned long (*scan)(unsigned long nr_to_scan);
+  struct list_head list;
+};
+
+// 后注册的 shrinker 先调用：上层缓存（如文件系统的块缓存）先把对象还给 slub，
+// 空出的 slab 再由先注册的 slub shrinker 归还给 buddy system
+void register_shrinker(struct shrinker *shrinker);
+
+// 依次调用所有 shrinker，每个最多回收 nr 个页面，返回回收的页面总数
+unsigned long shrink_caches(unsigned long nr);
+
+// 把 alloc_pages(num) 得到的块拆成 num 个可以单独释放的页面，多出的页面归还
+void split_pages(uint64_t pa, unsigned int num);
+
+// 用户页面的引用计数，记录在 struct page 中，每个映射该页面的页表项计一次。
+// 只对 buddy system 管理的页面有效，其余页面（如内核镜像中的用户程序）不计数
+uint64_t alloc_user_pages(unsigned int num, unsigned int flags);
+void get_page(uint64_t pa);
+// 引用计数减一，减到 0 时释放页面
+void put_page(uint64_t pa);
+int page_count(uint64_t pa);
+
 void slub_init();
 
-void memcpy(void * dst, void * src, size_t size);
-void *memset(void *dst, int c, uint32_t n);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "defs.h"
+#include "task_manager.h"
+
+// 缺页时除了出错的页面，还顺带映射同一个对齐窗口内、同一 VMA 中尚未驻留的页面，
+// 窗口大小为 fault_around_pages 个页面，为 1 时只映射出错的页面
+#define FAULT_AROUND_PAGES 4
+
+extern int fault_around_pages;
+
+// 页面异常的 scause
+#define CAUSE_FETCH_PAGE_FAULT 0xc
+#define CAUSE_LOAD_PAGE_FAULT 0xd
+#define CAUSE_STORE_PAGE_FAULT 0xf
+
+// 建立 vm_area_struct 的 slab cache，在 slub_init 之后调用
+void mmap_init(void);
+
+// 初始化一个没有任何 VMA 的 mm
+void mm_init(struct mm_struct *mm);
+
+// 返回包含 addr 的 VMA，不存在时返回 NULL，O(log n)
+struct vm_area_struct *find_vma(struct mm_struct *mm, uint64_t addr);
+
+// 在 mm 中新建 [start, start + len) 的 VMA，此时不分配任何物理页面。
+// start 必须按页对齐，len 向上取整到页；与已有 VMA 重叠时返回 NULL，
+// 与首尾相接且权限相同的 VMA 合并，返回合并后的 VMA
+struct vm_area_struct *do_mmap(struct mm_struct *mm, uint64_t start,
+                               uint64_t len, uint64_t flags);
+
+// 解除 [start, start + len) 的映射，可以跨越多个 VMA，也可以只解除 VMA 的一部分
+int do_munmap(struct mm_struct *mm, uint64_t pgtbl, uint64_t start,
+              uint64_t len);
+
+// 释放 mm 中所有的 VMA
+void exit_mmap(struct mm_struct *mm, uint64_t pgtbl);
+
+// fork 时复制 VMA，驻留的页面以写时复制的方式共享
+int dup_mmap(struct mm_struct *dst, uint64_t dst_pgtbl,
+             struct mm_struct *src, uint64_t src_pgtbl);
+
+// 处理当前进程在 addr 处的缺页，成功时返回 0
+int handle_mm_fault(uint64_t addr, uint64_t cause);
@@ -1,5 +1,16 @@
 #pragma once
 
+#define SSTATUS_SIE (1UL << 1)
+
+// sstatus.FS：浮点单元的状态，写浮点寄存器或 fcsr 时硬件把它置为 Dirty
+#define SSTATUS_FS (3UL << 13)
+#define SSTATUS_FS_OFF (0UL << 13)     // 关闭，浮点指令产生非法指令异常
+#define SSTATUS_FS_INITIAL (1UL << 13) // 打开，寄存器为初始值
+#define SSTATUS_FS_CLEAN (2UL << 13)   // 打开，寄存器与保存区一致
+#define SSTATUS_FS_DIRTY (3UL << 13)   // 打开，寄存器被修改过，切换出去时需要保存
+#define SIP_SSIP (1UL << 1)
+#define SIP_STIP (1UL << 5)
+
 #define write_csr(reg, val)                                     \
   ({                                                            \
     if (__builtin_constant_p(val) && (unsigned long)(val) < 32) \
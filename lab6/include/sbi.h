@@ -0,0 +1,30 @@
+#pragma once
+
+// S 模式通过 ecall 请求 M 模式（head.S 中的 _mtrap）代为完成的操作。
+// a7 为请求编号，与 SBI v0.1 的 legacy 扩展相同，a0 为参数。
+// 与 SBI 规范不同，SEND_IPI 的 a0 直接是目标 hart 的位图而不是指向位图的指针，
+// 因为 M 模式不经过页表访问内存
+#define SBI_SET_TIMER 0
+#define SBI_SEND_IPI 4
+
+#ifndef __ASSEMBLER__
+
+#include "defs.h"
+
+static inline void sbi_call(uint64_t which, uint64_t arg0) {
+  register uint64_t a0 asm("a0") = arg0;
+  register uint64_t a7 asm("a7") = which;
+  asm volatile("ecall" : "+r"(a0) : "r"(a7) : "memory");
+}
+
+// 设置本 hart 下一次时钟中断的 mtime 绝对时间，TIMER_OFF 表示停止
+static inline void sbi_set_timer(uint64_t deadline) {
+  sbi_call(SBI_SET_TIMER, deadline);
+}
+
+// 向 hart_mask 中的每个 hart 发送 M 模式软件中断
+static inline void sbi_send_ipi(uint64_t hart_mask) {
+  sbi_call(SBI_SEND_IPI, hart_mask);
+}
+
+#endif
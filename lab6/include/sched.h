@@ -3,9 +3,72 @@
 
 #ifndef __ASSEMBLER__
 
+/* 运行队列：每个 hart 一个，只包含该 hart 上可运行的进程（包括正在运行的），
+   空闲的 hart 从其他 hart 的队列中窃取进程，
+   每个优先级一条 FIFO 链表，bitmap 的第 i 位表示第 i 条链表非空，
+   选择下一个进程只需找最低的置位。没有可运行的进程时运行 idle */
+struct runqueue {
+  spinlock_t lock;
+  uint64_t bitmap;
+  struct list_head queue[MAX_PRIO];
+  unsigned long nr_running;
+  struct task_struct *idle; // 该 hart 的启动上下文，不在队列中
+  struct task_struct *curr; // 正在运行的进程，在 schedule 中更新
+  /* 空闲时间统计，单位为 mtime 的计数 */
+  uint64_t start_time;      // 该 hart 登记空闲进程的时间
+  uint64_t idle_start;      // 上一次切换到空闲进程的时间
+  uint64_t idle_time;       // 不包括当前这段空闲
+};
+
+/* 一个 hart 自上线以来在空闲进程中和在其他进程中的时间，单位为 mtime 的计数 */
+struct cpu_stat {
+  uint64_t idle;
+  uint64_t busy;
+};
+
+/* 时间片长度，单位为时钟中断：优先级 0 为 MAX_TIMESLICE，
+   优先级 MAX_PRIO-1 为 MIN_TIMESLICE，中间按优先级线性分配 */
+#define MIN_TIMESLICE 1
+#define MAX_TIMESLICE 8
+
+static inline long task_timeslice(struct task_struct *p) {
+  return MIN_TIMESLICE + (MAX_TIMESLICE - MIN_TIMESLICE) *
+                             (MAX_PRIO - 1 - p->priority) / (MAX_PRIO - 1);
+}
+
+/* 初始化所有 hart 的运行队列，在创建第一个进程之前由启动 hart 调用 */
+void sched_init(void);
+
+/* 把当前 hart 的启动上下文登记为它的空闲进程，每个 hart 进入内核后调用一次 */
+void init_idle(void);
+
+/* fork 出的进程放到哪个 hart 上：可运行进程最少的在线 hart，相同时优先当前 hart */
+int select_task_rq(void);
+
+/* 进程变为可运行时加入 p->cpu 的运行队列的队尾，
+   使该 hart 需要重新开始 tick 时通知它 */
+void enqueue_task(struct task_struct *p);
+
+/* 进程不再可运行时移出运行队列 */
+void dequeue_task(struct task_struct *p);
+
+/* 当前 hart 没有可运行的进程时，从可运行进程最多的其他 hart 窃取一个：
+   跳过正在运行的进程和刚在那个 hart 上运行过的进程。窃取到时返回 1 */
+bool idle_balance(void);
+
+/* 当前 hart 是否有多于一个可运行的进程，只有这时才需要 tick 来轮转时间片 */
+bool sched_need_tick(void);
+
+/* 修改进程的优先级，已在运行队列中的进程移到新优先级的队尾 */
+void set_task_prio(struct task_struct *p, long prio);
+
+/* 当前 hart 上优先级最高的非空队列的队首，跳过 skip（可以为 NULL），
+   没有可运行的进程时返回 NULL。skip 只占一个节点，因此最多多看一个节点和一条队列 */
+struct task_struct *pick_next_task(struct task_struct *skip);
+
 void call_first_process(void);
 
-/* 在时钟中断处理中被调用 */
+/* 在时钟中断处理中被调用，当前进程的时间片用完时切换到同优先级的下一个进程 */
 void do_timer(void);
 
 /* 调度程序 */
@@ -14,9 +77,19 @@ void schedule(bool self);
 /* 切换当前任务current到下一个任务next */
 void switch_to(struct task_struct *next);
 
-extern void __switch_to(struct task_struct *prev, struct task_struct *next);
+/* 切换到 next 之后、在 next 的上下文中完成对 prev 的收尾，已经退出的 prev 在这里
+   放下调度器持有的引用。fork 出的进程第一次运行时由 ret_from_fork 调用 */
+void schedule_tail(struct task_struct *prev);
+
+/* 返回值为切换前的进程：回到某个进程的上下文时，它当初的 prev 已经失效 */
+extern struct task_struct *__switch_to(struct task_struct *prev,
+                                       struct task_struct *next);
+
+/* 填入 hart 0 到 n-1 的 cpu_stat，未上线的 hart 全为 0，返回填入的个数 */
+int get_cpu_stat(struct cpu_stat *stat, int n);
 
-/* 死循环 */
+/* 空闲进程：运行队列中出现进程或者窃取到进程时切换过去，
+   没有事情可做时在 wfi 中等待时钟中断或其他 hart 的通知 */
 void dead_loop(void);
 
 #endif
@@ -2,17 +2,20 @@
 
 #include "list.h"
 #include "defs.h"
+#include "smp.h"
+#include "spinlock.h"
 
-#define NR_PARTIAL 9
+#define NR_PARTIAL 12
 #define PAGE_SHIFT 12
 #define PPN_SHIFT 10
 #define PAGE_MASK (~((1UL << PAGE_SHIFT) - 1))
-#define MEM_SHIFT (24 - PAGE_SHIFT)
 #define STRUCTURE_SIZE 16UL
 
 struct page {
   unsigned long flags;
-  int count;
+  int count;    /* Objects in use for slabs; cache->objects for the cpu slab;
+                   pages of a large kmalloc, in its first page */
+  int refcount; /* Number of user mappings, see get_page/put_page */
   struct page *header;
   struct page *next;
   struct list_head slub_list;
@@ -26,11 +29,18 @@ struct cache_area {
   void *freelist;
 };
 
+/*
+ * Objects are addressed physically and all memory lies below 4GB, so the
+ * freelist head and the transaction id fit in one word and are replaced
+ * together by a single LR/SC cmpxchg.
+ */
+struct kmem_cache_cpu {
+  uint64_t freelist_tid; /* Next available object (low 32 bits) and tid */
+  struct page *page;     /* The slab from which we are allocating */
+};
+
 struct kmem_cache {
-  /* kmem_cache_cpu */
-  void **freelist;   /* Pointer to next available object */
-  unsigned long tid; /* Globally unique transaction id */
-  struct page *page; /* The slab from which we are allocating */
+  struct kmem_cache_cpu cpu_slab[NR_CPUS];
 
   /* Used for retrieving partial slabs, etc. */
   int refcount;
@@ -39,6 +49,7 @@ struct kmem_cache {
   size_t object_size;  /* The size of an object without metadata */
   unsigned int offset; /* Free pointer offset */
   unsigned long nr_page_per_slub;
+  unsigned int objects; /* Number of objects in a slab */
 
   void (*init_func)(void *);
   unsigned int inuse;        /* Offset to metadata */
@@ -48,12 +59,15 @@ struct kmem_cache {
   struct list_head list;     /* List of slab caches */
 
   /* kmem_cache_node */
+  spinlock_t list_lock; /* Protects the slab lists and page->freelist */
   unsigned long nr_partial;
-  struct list_head partial;
-#ifdef CONFIG_SLUB_DEBUG
+  struct list_head partial; /* Slabs with both free and allocated objects */
+  struct list_head full;    /* Slabs with no free object */
+  unsigned long nr_free;
+  struct list_head free;    /* Empty slabs kept for reuse, at most min_partial */
   unsigned long nr_slabs;
+#ifdef CONFIG_SLUB_DEBUG
   unsigned long total_objects;
-  struct list_head full;
 #endif
 };
 
@@ -61,8 +75,20 @@ void slub_init();
 struct kmem_cache *kmem_cache_create(const char *, size_t, unsigned int, int,
                                      void *(void *));
 
+/* Fails with -1 while the cache still has objects in use */
+int kmem_cache_destroy(struct kmem_cache *);
+
+/* Returns an uninitialized object, or a constructed one if the cache has a
+ * constructor. Objects of such caches must be freed in constructed state. */
 void *kmem_cache_alloc(struct kmem_cache *);
 void kmem_cache_free(void *);
 
+struct page *addr_to_page(uint64_t addr);
+
+/* kmalloc returns uninitialized memory, kzalloc returns zeroed memory */
 void *kmalloc(size_t);
+void *kzalloc(size_t);
 void kfree(const void *);
+
+/* Print slab count and object/byte utilization of every cache */
+void slub_report(void);
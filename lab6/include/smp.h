@@ -0,0 +1,51 @@
+#pragma once
+
+// 内核支持的最大 hart 数，每个 hart 有自己的 slub cpu freelist、运行队列等数据。
+// 修改时需要同步修改 vmlinux.lds 中按 4 个 hart 预留的栈
+#define NR_CPUS 4
+
+// S 模式下 tp 始终指向当前 hart 上运行的进程的 task_struct，
+// 其中 cpu 字段（偏移与 task_manager.h 中的定义一致）记录该进程所在的 hart
+#define TASK_CPU_OFFSET (5 * 0x08)
+
+// 核间中断的类型，按位记录在目标 hart 的 ipi_pending 中。
+// IPI_TLB_FLUSH 由目标 hart 的 M 模式直接执行 sfence.vma，其余的转发给 S 模式处理
+#define IPI_RESCHEDULE 0x1 // 运行队列发生了变化
+#define IPI_TLB_FLUSH 0x2  // 刷新整个 TLB
+
+#ifndef __ASSEMBLER__
+
+#include "defs.h"
+
+// 当前 hart 的编号。内核中没有抢占，读出后在下一次 schedule 之前都有效
+static inline int smp_processor_id(void) {
+  int cpu;
+  asm volatile("lw %0, %1(tp)" : "=r"(cpu) : "i"(TASK_CPU_OFFSET));
+  return cpu;
+}
+
+extern volatile uint64_t ipi_pending[NR_CPUS];
+
+// 已经进入内核的 hart，第 i 位对应 hart i
+extern volatile uint64_t cpu_online_mask;
+
+static inline bool cpu_online(int cpu) {
+  return (cpu_online_mask >> cpu) & 1;
+}
+
+// 启动 hart 唤醒停在 M 模式中的其他 hart，等待它们进入内核
+void smp_boot_secondaries(void);
+
+// 其他 hart 进入 S 模式后的入口，见 head.S
+void secondary_start_kernel(void);
+
+// 通知 cpu 它的运行队列发生了变化，需要重新计算 tick
+void smp_send_reschedule(int cpu);
+
+// 刷新其他在线 hart 的整个 TLB，返回时已经全部完成，本 hart 由调用者自己刷新
+void smp_flush_tlb_others(void);
+
+// S 模式软件中断的处理函数
+void smp_ipi_interrupt(void);
+
+#endif
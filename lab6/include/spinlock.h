@@ -0,0 +1,67 @@
+#pragma once
+
+#include "atomic.h"
+#include "riscv.h"
+
+typedef struct {
+  volatile uint32_t lock;
+} spinlock_t;
+
+#define SPINLOCK_INIT {0}
+
+static inline void spin_lock_init(spinlock_t *lock) {
+  lock->lock = 0;
+}
+
+static inline void spin_lock(spinlock_t *lock) {
+  uint32_t busy;
+  while (1) {
+    asm volatile("amoswap.w.aq %0, %2, %1"
+                 : "=r"(busy), "+A"(lock->lock)
+                 : "r"(1)
+                 : "memory");
+    if (!busy) {
+      return;
+    }
+    // 只读等待，避免持续的 AMO 写争用
+    while (READ_ONCE(lock->lock))
+      ;
+  }
+}
+
+// 只尝试一次，获得锁时返回 1。用于可能在持锁路径中被重入的回调（如 shrinker）
+static inline bool spin_trylock(spinlock_t *lock) {
+  uint32_t busy;
+  asm volatile("amoswap.w.aq %0, %2, %1"
+               : "=r"(busy), "+A"(lock->lock)
+               : "r"(1)
+               : "memory");
+  return !busy;
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+  asm volatile("amoswap.w.rl zero, zero, %0" : "+A"(lock->lock) : : "memory");
+}
+
+// 关闭当前 hart 的 S 态中断，返回之前的 SIE 位
+static inline unsigned long local_irq_save(void) {
+  return clear_csr(sstatus, SSTATUS_SIE) & SSTATUS_SIE;
+}
+
+static inline void local_irq_restore(unsigned long flags) {
+  if (flags) {
+    set_csr(sstatus, SSTATUS_SIE);
+  }
+}
+
+static inline unsigned long spin_lock_irqsave(spinlock_t *lock) {
+  unsigned long flags = local_irq_save();
+  spin_lock(lock);
+  return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock,
+                                          unsigned long flags) {
+  spin_unlock(lock);
+  local_irq_restore(flags);
+}
@@ -2,9 +2,11 @@
 
 #include "defs.h" // 确保能通过它找到 size_t, uint32_t 等定义
 
+void *memcpy(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
 int memcmp(const void *v1, const void *v2, size_t n);
 
 size_t strlen(const char *s);
 char *strcpy(char *dst, const char *src);
 char *strncpy(char *dst, const char *src, size_t n);
-int strcmp(const char *s1, const char *s2);
\ No newline at end of file
+int strcmp(const char *s1, const char *s2);
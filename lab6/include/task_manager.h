@@ -1,25 +1,35 @@
 #pragma once
 #include "defs.h"
+#include "fpu.h"
 #include "fs.h"
 #include "list.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "wait.h"
 
 #define TASK_SIZE (4096)
-#define THREAD_OFFSET (5 * 0x08)
+#define THREAD_OFFSET (6 * 0x08)
 
 #ifndef __ASSEMBLER__
 
-/* task的最大数量 */
-#define NR_TASKS 64
+/* pid 的范围为 [0, PID_MAX)，0 留给第一个进程，fork 从 1 开始分配；空闲进程的 pid 为 -1 */
+#define PID_MAX 32768
 
-#define FIRST_TASK (task[0])
-#define LAST_TASK (task[NR_TASKS - 1])
-
-/* 定义task的状态，lab3中task只需要一种状态。*/
+/* 定义task的状态：已经退出、等待父进程回收的进程为 TASK_ZOMBIE，
+   被回收或没有父进程的为 TASK_DEAD，放下最后一个引用时释放 pid 和 task_struct */
 #define TASK_RUNNING 0
-// #define TASK_INTERRUPTIBLE       1
+#define TASK_INTERRUPTIBLE       1
 // #define TASK_UNINTERRUPTIBLE     2
-// #define TASK_ZOMBIE              3
+#define TASK_ZOMBIE              3
 // #define TASK_STOPPED             4
+#define TASK_DEAD                5
+
+/* 优先级范围为 [0, MAX_PRIO)，数值越小优先级越高，每个优先级对应一条运行队列 */
+#define MAX_PRIO 64
+/* 第一个进程（shell）的优先级最低，时间片最短；fork 出的子进程先于它运行，
+   位于优先级范围的中间，时间片见 task_timeslice */
+#define INIT_TASK_PRIO (MAX_PRIO - 1)
+#define DEFAULT_PRIO (MAX_PRIO / 2)
 
 #define PREEMPT_ENABLE 0
 #define PREEMPT_DISABLE 1
@@ -28,11 +38,17 @@
 #define LAB_TEST_NUM 5
 #define LAB_TEST_COUNTER 5
 
-/* 当前进程 */
-extern struct task_struct *current;
+/* 当前进程：每个 hart 的 tp 指向它正在运行的进程，由 __switch_to 切换，
+   从用户态进入 trap_s 时由内核栈所在的页面重新得到 */
+static inline struct task_struct *get_current(void) {
+  struct task_struct *p;
+  asm volatile("mv %0, tp" : "=r"(p));
+  return p;
+}
+#define current get_current()
 
-/* 进程指针数组 */
-extern struct task_struct *task[NR_TASKS];
+/* 保护 pid 的分配和查找、进程的引用计数，以及各进程的 parent、children、exit_code 和 wait_chldexit */
+extern spinlock_t tasklist_lock;
 
 /* 进程状态段数据结构 */
 struct thread_struct {
@@ -69,15 +85,23 @@ struct vm_area_struct {
   pgprot_t vm_page_prot;
   /* Flags*/
   unsigned long vm_flags;
-  /* mapped */
-  bool mapped;
+  /* 驻留位图，第 i 位表示 VMA 中的第 i 个页面已经分配并映射 */
+  uint64_t *resident;
+  unsigned long nr_resident;
+  /* 按 vm_start 排序的 AVL 树 */
+  struct vm_area_struct *vm_left, *vm_right;
+  int vm_height;
 };
 
 /* 内存管理 */
 struct mm_struct {
-  struct vm_area_struct *vm;   // 虚拟内存区域描述符
+  struct vm_area_struct *vm;   // 虚拟内存区域描述符，链表按地址排序
+  struct vm_area_struct *mmap_root;  // 以 VMA 起始地址为键的 AVL 树
+  struct vm_area_struct *mmap_cache; // 上一次 find_vma 命中的 VMA
+  int map_count;                     // VMA 的数量
+  uint64_t context_id;               // 高位为 ASID 的代数，低 asid_bits 位为 ASID
+  long last_cpu;                     // 上一次在哪个 hart 上运行，其他 hart 的 TLB 中可能还有旧映射
   uint64_t user_program_start; // 进程起始地址（物理）
-  uint64_t user_stack;         // 用户栈地址(物理)
 };
 
 struct file {
@@ -95,23 +119,54 @@ struct files_struct {
 /* 进程数据结构 */
 struct task_struct {
   long state;    // 进程状态 Lab3中进程初始化时置为TASK_RUNNING
-  long counter;  // 运行剩余时间
-  long priority; // 运行优先级 1最高 5最低
+  long counter;  // 剩余的时间片，单位为时钟中断
+  long priority; // 运行优先级 0最高 MAX_PRIO-1最低
   long blocked;
   long pid; // 进程标识符
-            // Above Size Cost: 40 bytes
+  long cpu; // 所在的 hart，偏移为 TASK_CPU_OFFSET
+            // Above Size Cost: 48 bytes
 
   struct thread_struct thread; // 该进程状态段
 
-  uint64_t sscratch; // 保存 sscratch
+  uint64_t sscratch; // 第一个进程的初始用户栈，由 __init_sepc 载入
   uint64_t satp;     // 保存 satp
 
   struct mm_struct mm;
   struct files_struct fs;
+
+  struct list_head run_list; // 可运行时挂在 cpu 的运行队列中，否则为空链表
+  long on_cpu;               // 正在某个 hart 上运行，包括切换出去的过程中，
+                             // 这时其他 hart 不能窃取它
+  uint64_t last_ran;         // 上一次切换出去时的 mtime，不久前运行过的进程在
+                             // 原来的 hart 上缓存和 TLB 还是热的
+
+  struct task_struct *parent; // 父进程，父进程先退出时为 NULL
+  struct list_head children;  // 子进程链表（包括尚未回收的 TASK_ZOMBIE）
+  struct list_head sibling;   // 在父进程 children 链表中的位置
+  long exit_code;             // exit 的参数，由 wait 交给父进程
+  long usage;                 // 引用计数：父进程的回收和最后一次切换出去各持有一个
+  struct wait_queue_head wait_chldexit; // 在 wait 中等待子进程退出
+
+  struct fp_state fp; // 浮点状态，只在切换出去时 FS 为 Dirty 才保存
+  long fp_cpu;        // 上一次把 fp 恢复到哪个 hart 的寄存器中，-1 表示没有
 };
 
 int getpid();
 
+/* 为 p 分配一个未使用的 pid 并登记，从上一次分配的 pid 之后开始找，刚释放的 pid
+   不会马上被复用。没有可用的 pid 或内存不足时返回 -1。调用者持有 tasklist_lock */
+long alloc_pid(struct task_struct *p);
+
+/* 释放 pid，调用者持有 tasklist_lock */
+void free_pid(long pid);
+
+/* 由 pid 找到进程，O(1)，不存在时返回 NULL。调用者持有 tasklist_lock */
+struct task_struct *find_task_by_pid(long pid);
+
+/* 放下一个对 p 的引用，最后一个引用释放 pid 和 task_struct 所在的页面。
+   调用者持有 tasklist_lock */
+void put_task_struct(struct task_struct *p);
+
 /* 进程初始化 创建四个dead_loop进程 */
 void task_init(void);
 
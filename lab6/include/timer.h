@@ -0,0 +1,38 @@
+#pragma once
+
+#include "defs.h"
+#include "list.h"
+
+// 时钟中断由 M 模式代为设置：S 模式 ecall 时 a0 为 mtime 下的绝对到期时间，
+// TIMER_OFF 表示停止时钟中断
+#define TIMER_OFF (~0UL)
+
+// 每秒的时钟中断数和一个 tick 对应的 mtime 增量，timer_init 之前为 0
+extern uint64_t tick_hz;
+extern uint64_t tick_cycles;
+
+// 一次性定时器，挂在调用 add_timer 的 hart 上，到期时在该 hart 的时钟中断中调用 function
+struct timer_list {
+  struct list_head entry;
+  uint64_t expires; // mtime 下的到期时间
+  void (*function)(struct timer_list *timer);
+};
+
+// 按设备树中的频率计算 tick 长度，并设置启动 hart 的第一次时钟中断
+void timer_init(void);
+
+// 设置其他 hart 的第一次时钟中断，在 timer_init 之后调用
+void timer_init_cpu(void);
+
+// 加入一个定时器，必要时把下一次时钟中断提前到它的到期时间
+void add_timer(struct timer_list *timer);
+
+// 删除尚未到期的定时器，必须在 add_timer 的那个 hart 上调用
+void del_timer(struct timer_list *timer);
+
+// 本 hart 的运行队列或定时器变化后重新计算下一次时钟中断：最早的定时器，
+// 以及有其他进程可以切换时的下一个 tick，两者都没有时停止时钟中断
+void timer_reprogram(void);
+
+// S 模式时钟中断的处理函数
+void timer_interrupt(void);
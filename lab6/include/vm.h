@@ -7,13 +7,127 @@
 #define PTE_W 0x004 // Write
 #define PTE_X 0x008 // Execute
 #define PTE_U 0x010 // User
+#define PTE_G 0x020 // Global，内核空间的映射在所有地址空间中相同
+#define PTE_COW 0x100 // RSW 位，写时复制的页面
+#define PTE_LEAF (PTE_R | PTE_W | PTE_X)
+#define PTE_FLAGS 0x3ff
+
+#define PTE_TO_PA(pte) ((((uint64_t)(pte)) >> 10) << 12)
+#define PA_TO_PTE(pa) ((((uint64_t)(pa)) >> 12) << 10)
+
+// satp：MODE 为 Sv39，ASID 位于 [59:44]，根页表的物理页号位于 [43:0]
+#define SATP_MODE_SV39 0x8000000000000000UL
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MAX_BITS 16
+#define SATP_PPN_MASK ((1UL << SATP_ASID_SHIFT) - 1)
+#define SATP_PGTBL(satp) (((uint64_t)(satp) & SATP_PPN_MASK) << 12)
+#define MAKE_SATP(pgtbl, asid)                                   \
+  (SATP_MODE_SV39 | ((uint64_t)(asid) << SATP_ASID_SHIFT) |      \
+   ((uint64_t)(pgtbl) >> 12))
+
+// Sv39 中第 level 级页表项映射的大小：0 级为 4KB，1 级为 2MB，2 级为 1GB
+#define LEVEL_SHIFT(level) (12 + 9 * (level))
+#define LEVEL_SIZE(level) (1UL << LEVEL_SHIFT(level))
 
 #define PHYSICAL_ADDR(x) (((uint64_t)(x)) & 0xffffffff | 0x80000000)
-#define VIRTUAL_ADDR(x) (((uint64_t)(x)) & 0xfffffff | 0xffffffc000000000)
+#define VIRTUAL_ADDR(x) (((uint64_t)(x)) & 0x7fffffff | 0xffffffc000000000)
+
+// 用户空间（0x1000000 附近）所在的顶层页表项
+#define USER_ROOT_INDEX 0
+
+// 用户 mmap 的地址范围是 [0, USER_MMAP_END)：第 0 个 1GB 中 PLIC（0x0c000000）
+// 以上是 MMIO 和内核空间，它们的页表由所有进程共享，不能由用户映射修改
+#define USER_MMAP_END 0x0c000000UL
+// 用户程序（2 页）和用户栈（1 页）由 exec/fork 直接建立映射，没有 VMA，mmap 不能覆盖
+#define USER_FIXED_START 0x1000000UL
+#define USER_FIXED_END 0x1003000UL
+
+// vmalloc 区：直接映射之上的一个 1GB，映射由不连续的物理页面拼成的内核缓冲区。
+// 这一项的二级页表在 paging_init 中预先分配，所有进程页表共享，
+// 因此之后在其中建立的映射对所有地址空间立即可见
+#define VMALLOC_START 0xffffffd000000000UL
+#define VMALLOC_END (VMALLOC_START + LEVEL_SIZE(2))
+#define VMALLOC_ROOT_INDEX ((VMALLOC_START >> LEVEL_SHIFT(2)) & 0x1ff)
+
+// 单次 munmap 超过该页数时刷新整个 ASID，否则逐页刷新
+#define TLB_FLUSH_PAGE_LIMIT 32
+
+// 硬件实现的 ASID 位数，为 0 时每次切换地址空间都要刷新 TLB
+extern uint64_t asid_bits;
+
+// 内核页表，同时是所有进程页表中内核空间的模板
+extern uint64_t *kernel_pgtbl;
+
+// 为 0 时 create_mapping 只使用 4KB 页面，用于基准测试中的对比
+extern int vm_superpages;
 
 void create_mapping(uint64_t *pgtbl, uint64_t va, uint64_t pa, uint64_t sz,
                     int perm);
 
 uint64_t get_pte(uint64_t *pgtbl, uint64_t va);
 
-void paging_init();
+// 释放 level 级页表 pgtbl 及其下所有的页表页面，不释放叶子项映射的页面
+void free_pgtbl(uint64_t *pgtbl, int level);
+
+// 建立内核空间的映射：全部物理内存的直接映射和等值映射，以及 MMIO
+void map_kernel_space(uint64_t *pgtbl);
+
+// 分配一个共享内核空间的进程根页表，返回其物理地址
+uint64_t new_user_pgtbl();
+
+// 释放进程页表中私有的页表页面，与内核页表共享的部分保留
+void free_user_pgtbl(uint64_t pgtbl);
+
+// fork 时以写时复制的方式把 src_pgtbl 中 [start, end) 的用户页面共享给 dst_pgtbl
+void copy_user_range(uint64_t dst_pgtbl, uint64_t src_pgtbl, uint64_t start,
+                     uint64_t end);
+
+// 解除 [start, end) 的用户页面映射并减少页面的引用计数
+void unmap_user_range(uint64_t pgtbl, uint64_t start, uint64_t end);
+
+// 解除内核页表中 va 处 4KB 页面的映射并刷新 TLB，返回原来映射的物理地址，未映射时返回 0
+uint64_t unmap_kernel_page(uint64_t va);
+
+// 处理对写时复制页面的写入，va 处不是写时复制页面时返回 -1
+int do_cow_fault(uint64_t pgtbl, uint64_t va);
+
+// 内核向当前进程的用户空间写入数据。目标超出用户地址范围或者
+// 其中的页面无法换入时不写入任何数据，返回 -1，成功时返回 0
+int copy_to_user(void *dst, const void *src, size_t n);
+
+// 返回内核根页表的物理地址
+uint64_t paging_init(uint64_t dtb_addr);
+
+/* TLB 刷新。带 ASID 的 sfence.vma 不会刷新 PTE_G 的内核映射 */
+
+static inline void local_flush_tlb_all(void) {
+  asm volatile("sfence.vma" : : : "memory");
+}
+
+static inline void flush_tlb_asid(uint64_t asid) {
+  asm volatile("sfence.vma zero, %0" : : "r"(asid) : "memory");
+}
+
+static inline void flush_tlb_page(uint64_t va, uint64_t asid) {
+  asm volatile("sfence.vma %0, %1" : : "r"(va), "r"(asid) : "memory");
+}
+
+// 刷新所有地址空间中 va 处的映射，包括 PTE_G 的内核映射
+static inline void flush_tlb_kernel_page(uint64_t va) {
+  asm volatile("sfence.vma %0, zero" : : "r"(va) : "memory");
+}
+
+// 刷新 asid 中 [start, end) 的映射
+void flush_tlb_range(uint64_t asid, uint64_t start, uint64_t end);
+
+struct mm_struct;
+struct task_struct;
+
+// 探测 ASID 位数，初始化 ASID 分配器，在第一次进程切换之前调用
+void asid_init(void);
+
+// mm 当前使用的 ASID
+uint64_t mm_asid(struct mm_struct *mm);
+
+// 切换到 next 的地址空间，必要时为其分配新一代的 ASID
+void switch_mm(struct task_struct *next);
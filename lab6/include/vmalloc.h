@@ -0,0 +1,21 @@
+#pragma once
+
+#include "defs.h"
+#include "vm.h"
+
+// vmalloc 分配的缓冲区在 [VMALLOC_START, VMALLOC_END) 中虚拟连续，
+// 由逐页分配的物理页面拼成，不会占用 buddy system 中的大块；
+// 物理上不连续，不能交给 virtio 等按物理地址访问的设备
+void *vmalloc(size_t size);
+// 同 vmalloc，返回全零的内存
+void *vzalloc(size_t size);
+void vfree(const void *addr);
+
+static inline bool is_vmalloc_addr(const void *addr) {
+  return (uint64_t)addr >= VMALLOC_START && (uint64_t)addr < VMALLOC_END;
+}
+
+// 不超过一页时使用 kmalloc，否则使用 vmalloc，用 kvfree 释放
+void *kvmalloc(size_t size);
+void *kvzalloc(size_t size);
+void kvfree(const void *addr);
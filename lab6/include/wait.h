@@ -0,0 +1,29 @@
+#pragma once
+
+#include "list.h"
+#include "spinlock.h"
+
+struct task_struct;
+
+/* 在等待队列上睡眠的进程，放在睡眠者自己的内核栈上 */
+struct wait_queue_entry {
+  struct task_struct *task;
+  struct list_head entry;
+};
+
+struct wait_queue_head {
+  struct list_head head;
+};
+
+static inline void init_waitqueue_head(struct wait_queue_head *wq) {
+  INIT_LIST_HEAD(&wq->head);
+}
+
+/* 当前进程离开运行队列，在 wq 上睡眠直到被 wake_up。
+   调用者持有保护等待条件的 lock 检查条件，lock 在睡眠期间释放、醒来后重新获得；
+   唤醒者修改条件和调用 wake_up 时持有同一把锁，因此其他 hart 上的唤醒不会丢失。
+   醒来不代表等待的条件已经成立，调用者需要重新检查 */
+void sleep_on(struct wait_queue_head *wq, spinlock_t *lock);
+
+/* 唤醒 wq 上所有睡眠的进程，放回各自的运行队列，调用者持有 sleep_on 的那把锁 */
+void wake_up(struct wait_queue_head *wq);